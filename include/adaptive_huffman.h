@@ -2,9 +2,12 @@
 #define __ADAPTIVE_HUFFMAN_H__
 
 #include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <vector>
 
+#include "stats.h"
+
 typedef unsigned char uchar_t;
 
 struct Node
@@ -23,9 +26,34 @@ struct Node
     }
 }; // struct Node
 
+// Only writers have an end of data to write, readers never set written
+template<typename STREAM>
+inline
+auto write_code(STREAM &stream, uchar_t *code, size_t size, int) -> decltype(stream.write_bits(code, size), void())
+{
+    stream.write_bits(code, size);
+}
+
+template<typename STREAM>
+inline
+void write_code(STREAM &, uchar_t *, size_t, long)
+{
+}
+
+// Decoding shortcut: where the tree walk started at some internal node ends
+// after following at most JUMP_BITS next bits of input.
+struct Jump
+{
+    uint16_t    node;
+    uint8_t     bits; // 0 marks table of given node as outdated
+}; // struct Jump
+
 template<typename BITSTREAM>
 class AdaptiveHuffman
 {
+    static const size_t JUMP_BITS = 4;
+    static const size_t JUMP_SIZE = 1 << JUMP_BITS;
+
     BITSTREAM           stream;
     std::vector<Node>   memory;
 
@@ -34,12 +62,33 @@ class AdaptiveHuffman
     std::vector<uint16_t>   byte2node;
     std::vector<uint16_t>   number2node;
 
+    // Decoder state, input is buffered here instead of being pulled from
+    // the stream bit by bit
+    std::vector<Jump>   jumps;
+    uint64_t    bits;
+    size_t      bits_size;
+    bool        eof;
+    bool        overrun;
+    bool        corrupted;
+    bool        terminated;
+
     size_t      last_count;
+    bool        written;
+
+    const uint16_t  *primer;
+
+    // For Stats
+    uint64_t    escapes;
+    uint64_t    swaps;
 
 public:
-    AdaptiveHuffman(BITSTREAM _stream);
+    AdaptiveHuffman(BITSTREAM _stream, const uint16_t *_primer=nullptr);
+    ~AdaptiveHuffman(void);
 
+    void flush(void);
+    void reset(void);
     bool good(void) const;
+    bool ended(void) const;
 
     void write(char *buffer, size_t bytes);
     void read(char *buffer, size_t bytes);
@@ -49,8 +98,15 @@ public:
 
     size_t gcount(void) const;
 
+    void collect(Stats &stats) const;
+
 private:
+    void prime(void);
     void get_code(uint16_t current, uchar_t *code, size_t &size);
+    void refill(void);
+    void consume(size_t count);
+    const Jump &jump(uint16_t current);
+    void invalidate(uint16_t current);
     void add_new_byte(uchar_t byte);
     void update_tree(uint16_t current);
 #ifndef NDEBUG
@@ -62,13 +118,25 @@ private:
 
 template<typename BITSTREAM>
 inline
-AdaptiveHuffman<BITSTREAM>::AdaptiveHuffman(BITSTREAM _stream)
+AdaptiveHuffman<BITSTREAM>::AdaptiveHuffman(BITSTREAM _stream, const uint16_t *_primer)
 :stream{_stream}
 ,memory{}
 ,null{1}
 ,root{null}
 ,byte2node{}
 ,number2node{}
+,jumps{}
+,bits{0}
+,bits_size{0}
+,eof{false}
+,overrun{false}
+,corrupted{false}
+,terminated{false}
+,last_count{0}
+,written{false}
+,primer{_primer}
+,escapes{0}
+,swaps{0}
 {
     memory.reserve(513);
     assert(memory.capacity() >= 513);
@@ -77,15 +145,107 @@ AdaptiveHuffman<BITSTREAM>::AdaptiveHuffman(BITSTREAM _stream)
     number2node.resize(513);
 
     number2node[512] = root;
+    prime();
+}
+
+template<typename BITSTREAM>
+inline
+AdaptiveHuffman<BITSTREAM>::~AdaptiveHuffman(void)
+{
+    flush();
+}
+
+// Encoded data ends with an escape code missing its byte, so the padding of
+// the last byte runs out of input in the decoder instead of decoding into
+// more symbols.
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::flush(void)
+{
+    if(!written)
+        return;
+
+    uchar_t code[64];
+    size_t size = 0;
+    get_code(null, code, size);
+    write_code(stream, code, size, 0);
+    written = false;
+}
+
+// Back to the empty (or primed) tree without giving back any memory. Only jump tables
+// of nodes that existed can be filled in.
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::reset(void)
+{
+    if(!jumps.empty())
+        for(size_t node = 0; node <= memory.size(); ++ node)
+            jumps[node * JUMP_SIZE].bits = 0;
+
+    memory.clear();
+    memory.emplace_back(0, 512);
+    null = 1;
+    root = null;
+    std::fill(begin(byte2node), end(byte2node), 0);
+    std::fill(begin(number2node), end(number2node), 0);
+    number2node[512] = root;
+    bits = 0;
+    bits_size = 0;
+    eof = false;
+    overrun = false;
+    corrupted = false;
+    terminated = false;
+    last_count = 0;
+    written = false;
+    prime();
+}
+
+// Starts from the tree primer (count of every byte value) builds, as if
+// those bytes had been coded already
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::prime(void)
+{
+    if(!primer)
+        return;
+
+    // Swaps made while priming are not the data's
+    uint64_t swapped = swaps;
+    for(size_t byte = 0; byte < 256; ++ byte)
+        for(size_t count = 0; count < primer[byte]; ++ count)
+            if(byte2node[byte])
+                update_tree(byte2node[byte]);
+
+            else
+                add_new_byte(byte);
+
+    swaps = swapped;
 }
 
 template<typename BITSTREAM>
 inline
 bool AdaptiveHuffman<BITSTREAM>::good(void) const
 {
+    if(corrupted)
+        return false;
+
+    // Running out of input while reading ahead is not an error until the
+    // missing bits are actually needed
+    if(eof)
+        return !overrun;
+
     return stream.good();
 }
 
+// Reading stopped at the escape flush() ends the data with, and all that
+// was left after it is the zero padding of the last byte
+template<typename BITSTREAM>
+inline
+bool AdaptiveHuffman<BITSTREAM>::ended(void) const
+{
+    return terminated && !bits;
+}
+
 template<typename BITSTREAM>
 inline
 void AdaptiveHuffman<BITSTREAM>::write(char *buffer, size_t bytes)
@@ -107,7 +267,10 @@ void AdaptiveHuffman<BITSTREAM>::read(char *buffer, size_t bytes)
     size_t count = bytes;
     while(bytes --)
         if(!get(*buffer ++))
+        {
+            last_count = count - bytes - 1;
             return;
+        }
 
     last_count = count;
 }
@@ -133,8 +296,10 @@ bool AdaptiveHuffman<BITSTREAM>::put(uchar_t byte)
         stream.write_bits(code, size);
         stream.write((char*) &byte, 1);
         add_new_byte(byte);
+        ++ escapes;
     }
 
+    written = true;
     last_count = 1;
     return true;
 }
@@ -144,37 +309,56 @@ inline
 bool AdaptiveHuffman<BITSTREAM>::get(char &byte)
 {
     last_count = 0;
+    if(jumps.empty())
+        jumps.resize((513 + 1) * JUMP_SIZE);
+
     uint16_t current = root;
-    while(current)
+    while(current != null && memory[current - 1].left)
     {
-        if(current == null)
-        {
-            stream.read((char*) &byte, 1);
-            last_count = stream.gcount();
-            if(!last_count)
-                return false;
+        if(bits_size < JUMP_BITS)
+            refill();
+
+        const Jump &next = jump(current);
+        consume(next.bits);
+        current = next.node;
+    }
 
-            add_new_byte(byte);
-            return true;
+    if(overrun)
+        return false;
+
+    if(current == null)
+    {
+        if(bits_size < 8)
+            refill();
+
+        if(bits_size < 8)
+        {
+            terminated = true;
+            overrun = true;
+            return false;
         }
 
-        Node &node = memory.at(current - 1);
-        if(!node.left)
+        byte = bits & 0xFF;
+        consume(8);
+        // Only bytes without a leaf are escaped, so a valid stream never
+        // grows the tree past its 513 nodes
+        if(byte2node[(uchar_t) byte] || memory.size() + 2 > number2node.size())
         {
-            assert(!node.right);
-            byte = node.byte;
-            update_tree(current);
-            last_count = 1;
-            return true;
+            corrupted = true;
+            return false;
         }
 
-        uchar_t bit = 0;
-        stream.read_bits(&bit, 1);
-        current = bit ? node.right : node.left;
+        add_new_byte(byte);
+        ++ escapes;
+        last_count = 1;
+        return true;
     }
 
-    assert(false && "Something went wrong");
-    return false;
+    assert(!memory[current - 1].right);
+    byte = memory[current - 1].byte;
+    update_tree(current);
+    last_count = 1;
+    return true;
 }
 
 template<typename BITSTREAM>
@@ -184,6 +368,14 @@ size_t AdaptiveHuffman<BITSTREAM>::gcount(void) const
     return last_count;
 }
 
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::collect(Stats &stats) const
+{
+    stats.escapes += escapes;
+    stats.swaps += swaps;
+}
+
 template<typename BITSTREAM>
 inline
 void AdaptiveHuffman<BITSTREAM>::get_code(uint16_t current, uchar_t *code, size_t &size)
@@ -218,12 +410,87 @@ void AdaptiveHuffman<BITSTREAM>::get_code(uint16_t current, uchar_t *code, size_
 
 }
 
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::refill(void)
+{
+    while(bits_size + 8 <= 64 && !eof)
+    {
+        uchar_t input[8];
+        size_t wanted = (64 - bits_size) / 8;
+        stream.read((char *) input, wanted);
+        size_t count = stream.gcount();
+        for(size_t i = 0; i < count; ++ i)
+        {
+            bits |= (uint64_t) input[i] << bits_size;
+            bits_size += 8;
+        }
+
+        eof = count < wanted;
+    }
+}
+
+// Past the end of input all bits read as zero, same as with per bit reads
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::consume(size_t count)
+{
+    if(count > bits_size)
+    {
+        overrun = true;
+        count = bits_size;
+    }
+
+    bits = count < 64 ? bits >> count : 0;
+    bits_size -= count;
+}
+
+template<typename BITSTREAM>
+inline
+const Jump &AdaptiveHuffman<BITSTREAM>::jump(uint16_t current)
+{
+    Jump *table = &jumps[current * JUMP_SIZE];
+    if(!table[0].bits)
+        for(size_t code = 0; code < JUMP_SIZE; ++ code)
+        {
+            uint16_t node = current;
+            uint8_t used = 0;
+            while(used < JUMP_BITS && node != null && memory[node - 1].left)
+            {
+                Node &parent = memory[node - 1];
+                node = (code >> used) & 1 ? parent.right : parent.left;
+                ++ used;
+            }
+
+            table[code] = {node, used};
+        }
+
+    return table[bits & (JUMP_SIZE - 1)];
+}
+
+// Children of current have changed, so have the jumps of every node that
+// can reach them in JUMP_BITS steps
+template<typename BITSTREAM>
+inline
+void AdaptiveHuffman<BITSTREAM>::invalidate(uint16_t current)
+{
+    if(jumps.empty())
+        return;
+
+    for(size_t level = 0; current && level < JUMP_BITS; ++ level)
+    {
+        jumps[current * JUMP_SIZE].bits = 0;
+        current = memory[current - 1].parent;
+    }
+}
+
 template<typename BITSTREAM>
 inline
 void AdaptiveHuffman<BITSTREAM>::add_new_byte(uchar_t byte)
 {
     assert(!byte2node.at(byte));
     assert(null);
+    invalidate(null);
     memory.emplace_back(0, memory.at(null - 1).number - 2, 0, null);
     memory.emplace_back(byte, memory.at(null - 1).number - 1, 0, null);
 
@@ -281,6 +548,8 @@ void AdaptiveHuffman<BITSTREAM>::exchange(uint16_t a, uint16_t b)
     Node &_b = memory.at(b - 1);
     Node &A = memory.at(_a.parent - 1);
     Node &B = memory.at(_b.parent - 1);;
+    invalidate(_a.parent);
+    invalidate(_b.parent);
     if(A.left == a && B.left == b)
         std::swap(A.left, B.left);
 
@@ -296,6 +565,7 @@ void AdaptiveHuffman<BITSTREAM>::exchange(uint16_t a, uint16_t b)
     std::swap(number2node.at(_a.number), number2node.at(_b.number));
     std::swap(_a.number, _b.number);
     std::swap(_a.parent, _b.parent);
+    ++ swaps;
 }
 
 #ifndef NDEBUG
@@ -0,0 +1,161 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+
+typedef unsigned char uchar_t;
+
+// One anonymous mapping handing out memory for large arrays. Pages are only
+// backed once touched and transparent huge pages are requested, so random
+// access over a big dictionary needs far fewer TLB entries. Nothing is freed
+// separately, the whole mapping goes away with the arena.
+class Arena
+{
+public:
+    static const size_t ALIGNMENT = 64;
+    static const size_t HUGE_PAGE = 1U << 21;
+
+private:
+    void        *mapping;
+    size_t      mapped;
+    uchar_t     *memory;
+    size_t      capacity;
+    size_t      used;
+
+public:
+    Arena(size_t _capacity);
+    ~Arena(void);
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t bytes);
+    bool owns(const void *pointer) const;
+}; // class Arena
+
+// Standard allocator taking memory from an Arena when it has one, and from
+// the heap otherwise (or once the arena is full).
+template<typename TYPE>
+class ArenaAllocator
+{
+public:
+    typedef TYPE value_type;
+
+    std::shared_ptr<Arena>  arena;
+
+    ArenaAllocator(std::shared_ptr<Arena> _arena=nullptr);
+
+    template<typename OTHER>
+    ArenaAllocator(const ArenaAllocator<OTHER> &other);
+
+    TYPE *allocate(size_t count);
+    void deallocate(TYPE *pointer, size_t count);
+
+    ArenaAllocator select_on_container_copy_construction(void) const;
+}; // class ArenaAllocator
+
+inline
+Arena::Arena(size_t _capacity)
+:mapping{nullptr}
+,mapped{0}
+,memory{nullptr}
+,capacity{_capacity}
+,used{0}
+{
+    // Huge pages need a huge page aligned start
+    mapped = capacity + HUGE_PAGE;
+    mapping = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mapping == MAP_FAILED)
+        throw std::bad_alloc();
+
+    memory = (uchar_t *) (((uintptr_t) mapping + HUGE_PAGE - 1) & ~(uintptr_t) (HUGE_PAGE - 1));
+#ifdef MADV_HUGEPAGE
+    madvise(memory, capacity, MADV_HUGEPAGE);
+#endif
+}
+
+inline
+Arena::~Arena(void)
+{
+    munmap(mapping, mapped);
+}
+
+inline
+void *Arena::allocate(size_t bytes)
+{
+    size_t start = (used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if(start + bytes > capacity)
+        return nullptr;
+
+    used = start + bytes;
+    return memory + start;
+}
+
+inline
+bool Arena::owns(const void *pointer) const
+{
+    return memory <= (const uchar_t *) pointer && (const uchar_t *) pointer < memory + capacity;
+}
+
+template<typename TYPE>
+inline
+ArenaAllocator<TYPE>::ArenaAllocator(std::shared_ptr<Arena> _arena)
+:arena{_arena}
+{
+}
+
+template<typename TYPE>
+template<typename OTHER>
+inline
+ArenaAllocator<TYPE>::ArenaAllocator(const ArenaAllocator<OTHER> &other)
+:arena{other.arena}
+{
+}
+
+template<typename TYPE>
+inline
+TYPE *ArenaAllocator<TYPE>::allocate(size_t count)
+{
+    if(arena)
+        if(void *pointer = arena->allocate(count * sizeof(TYPE)))
+            return (TYPE *) pointer;
+
+    return std::allocator<TYPE>().allocate(count);
+}
+
+template<typename TYPE>
+inline
+void ArenaAllocator<TYPE>::deallocate(TYPE *pointer, size_t count)
+{
+    if(arena && arena->owns(pointer))
+        return;
+
+    std::allocator<TYPE>().deallocate(pointer, count);
+}
+
+// The arena is sized for one set of arrays, copies go to the heap
+template<typename TYPE>
+inline
+ArenaAllocator<TYPE> ArenaAllocator<TYPE>::select_on_container_copy_construction(void) const
+{
+    return ArenaAllocator{};
+}
+
+template<typename TYPE, typename OTHER>
+inline
+bool operator==(const ArenaAllocator<TYPE> &a, const ArenaAllocator<OTHER> &b)
+{
+    return a.arena == b.arena;
+}
+
+template<typename TYPE, typename OTHER>
+inline
+bool operator!=(const ArenaAllocator<TYPE> &a, const ArenaAllocator<OTHER> &b)
+{
+    return !(a == b);
+}
+
+#endif // __ARENA_H__
@@ -0,0 +1,209 @@
+#ifndef __BATCH_RING_H__
+#define __BATCH_RING_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Bounded lock-free queue of byte batches between one producer and one
+// consumer thread. Slots keep their buffers, so once they have grown to the
+// batch size passing a batch is one copy and one atomic store. A side that
+// has to wait (ring full or empty) yields its time slice instead of
+// sleeping on a lock.
+class BatchRing
+{
+public:
+    struct Batch
+    {
+        std::vector<char>   data;
+        size_t              size;
+    }; // struct Batch
+
+private:
+    std::vector<Batch>  slots;
+    std::atomic<size_t> head; // next batch to consume
+    std::atomic<size_t> tail; // next batch to produce
+    std::atomic<bool>   closed;
+    std::atomic<bool>   cancelled;
+
+public:
+    BatchRing(size_t _slots=8);
+
+    BatchRing(const BatchRing &) = delete;
+    BatchRing &operator=(const BatchRing &) = delete;
+
+    // Producer side
+    bool push(const char *buffer, size_t bytes);
+    void close(void);
+
+    // Consumer side
+    Batch *front(void);
+    void pop(void);
+    void cancel(void);
+}; // class BatchRing
+
+// Producer end of a ring as an output stream, every write is one batch
+class RingSink
+{
+    BatchRing   &ring;
+
+public:
+    RingSink(BatchRing &_ring);
+
+    bool good(void) const;
+    void write(const char *buffer, size_t bytes);
+}; // class RingSink
+
+// Consumer end of a ring as an input stream, ends like std::istream: a
+// read that comes up short marks the end of input
+class RingSource
+{
+    BatchRing   &ring;
+    size_t      position;
+    size_t      last_count;
+    bool        eof;
+
+public:
+    RingSource(BatchRing &_ring);
+
+    bool good(void) const;
+    void read(char *buffer, size_t bytes);
+    size_t gcount(void) const;
+}; // class RingSource
+
+inline
+BatchRing::BatchRing(size_t _slots)
+:slots(_slots)
+,head{0}
+,tail{0}
+,closed{false}
+,cancelled{false}
+{
+}
+
+// Waits for a free slot. False once the consumer cancelled, the batch is
+// dropped then.
+inline
+bool BatchRing::push(const char *buffer, size_t bytes)
+{
+    size_t current = tail.load(std::memory_order_relaxed);
+    while(current - head.load(std::memory_order_acquire) == slots.size())
+    {
+        if(cancelled.load(std::memory_order_relaxed))
+            return false;
+
+        std::this_thread::yield();
+    }
+
+    Batch &batch = slots[current % slots.size()];
+    batch.data.resize(std::max(batch.data.size(), bytes));
+    memcpy(batch.data.data(), buffer, bytes);
+    batch.size = bytes;
+    tail.store(current + 1, std::memory_order_release);
+    return !cancelled.load(std::memory_order_relaxed);
+}
+
+// No more batches will come
+inline
+void BatchRing::close(void)
+{
+    closed.store(true, std::memory_order_release);
+}
+
+// Waits for the next batch, nullptr once the ring is closed and empty
+inline
+BatchRing::Batch *BatchRing::front(void)
+{
+    size_t current = head.load(std::memory_order_relaxed);
+    while(current == tail.load(std::memory_order_acquire))
+    {
+        // Batches pushed before close() are visible once it is
+        if(closed.load(std::memory_order_acquire) && current == tail.load(std::memory_order_acquire))
+            return nullptr;
+
+        std::this_thread::yield();
+    }
+
+    return &slots[current % slots.size()];
+}
+
+inline
+void BatchRing::pop(void)
+{
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Consumer gives up, a producer waiting for room stops waiting
+inline
+void BatchRing::cancel(void)
+{
+    cancelled.store(true, std::memory_order_relaxed);
+}
+
+inline
+RingSink::RingSink(BatchRing &_ring)
+:ring(_ring)
+{
+}
+
+inline
+bool RingSink::good(void) const
+{
+    return true;
+}
+
+inline
+void RingSink::write(const char *buffer, size_t bytes)
+{
+    ring.push(buffer, bytes);
+}
+
+inline
+RingSource::RingSource(BatchRing &_ring)
+:ring(_ring)
+,position{0}
+,last_count{0}
+,eof{false}
+{
+}
+
+inline
+bool RingSource::good(void) const
+{
+    return !eof;
+}
+
+inline
+void RingSource::read(char *buffer, size_t bytes)
+{
+    last_count = 0;
+    while(last_count < bytes)
+    {
+        BatchRing::Batch *batch = ring.front();
+        if(!batch)
+            break;
+
+        size_t chunk = std::min(bytes - last_count, batch->size - position);
+        memcpy(buffer + last_count, batch->data.data() + position, chunk);
+        last_count += chunk;
+        position += chunk;
+        if(position == batch->size)
+        {
+            ring.pop();
+            position = 0;
+        }
+    }
+
+    eof = last_count < bytes;
+}
+
+inline
+size_t RingSource::gcount(void) const
+{
+    return last_count;
+}
+
+#endif // __BATCH_RING_H__
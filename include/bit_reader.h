@@ -0,0 +1,283 @@
+#ifndef __BIT_READER_H__
+#define __BIT_READER_H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "stats.h"
+
+typedef unsigned char uchar_t;
+
+// Reading counterpart of BitStream. Input is pulled from the underlying
+// stream in large chunks and the 64-bit accumulator is refilled a word at a
+// time, so a read is a mask and a shift in the common case. Bits above
+// accumulator_size are either zero or the next bits of the buffer, which is
+// what makes whole word refills safe.
+template<typename STREAM>
+class BitReader
+{
+    static const size_t MAX_PEEK = 56;
+
+    STREAM              stream;
+    std::vector<uchar_t> input;
+    size_t              position;
+    size_t              end;
+    uint64_t            accumulator;
+    size_t              accumulator_size;
+    size_t              last_count;
+    bool                eof;
+    bool                overrun;
+    bool                padded;
+
+public:
+    BitReader(STREAM _stream, size_t _buffer_size=1U << 16);
+
+    void reset(void);
+    bool good(void) const;
+    bool ended(void) const;
+
+    uint64_t peek(size_t bits);
+    void consume(size_t bits);
+
+    bool read_bits(uchar_t *buffer, size_t bits);
+    void read(char *buffer, size_t bytes);
+
+    size_t gcount(void) const;
+
+    void collect(Stats &stats) const;
+
+private:
+    bool fill(void);
+    void refill(void);
+}; // class BitReader
+
+template<typename STREAM>
+inline
+BitReader<STREAM>::BitReader(STREAM _stream, size_t _buffer_size)
+:stream{_stream}
+,input(_buffer_size)
+,position{0}
+,end{0}
+,accumulator{0}
+,accumulator_size{0}
+,last_count{0}
+,eof{false}
+,overrun{false}
+,padded{false}
+{
+}
+
+// Forgets buffered input, the stream itself is left alone
+template<typename STREAM>
+inline
+void BitReader<STREAM>::reset(void)
+{
+    position = 0;
+    end = 0;
+    accumulator = 0;
+    accumulator_size = 0;
+    last_count = 0;
+    eof = false;
+    overrun = false;
+    padded = false;
+}
+
+// Fails only once more bits were requested than there were left
+template<typename STREAM>
+inline
+bool BitReader<STREAM>::good(void) const
+{
+    return !overrun;
+}
+
+// Input ran out in read_bits or consume with nothing but the zero padding of the last
+// byte left, which is how data written by BitWriter ends
+template<typename STREAM>
+inline
+bool BitReader<STREAM>::ended(void) const
+{
+    return overrun && padded;
+}
+
+// Next bits of input without consuming them, at most MAX_PEEK at a time.
+// Past the end of input all bits read as zero.
+template<typename STREAM>
+inline
+uint64_t BitReader<STREAM>::peek(size_t bits)
+{
+    assert(bits <= MAX_PEEK);
+    if(accumulator_size < bits)
+        refill();
+
+    return accumulator & (((uint64_t) 1 << bits) - 1);
+}
+
+template<typename STREAM>
+inline
+void BitReader<STREAM>::consume(size_t bits)
+{
+    assert(bits <= MAX_PEEK);
+    if(bits > accumulator_size)
+    {
+        if(!overrun)
+            padded = accumulator_size < 8 && !(accumulator & (((uint64_t) 1 << accumulator_size) - 1));
+
+        overrun = true;
+        bits = accumulator_size;
+    }
+
+    accumulator >>= bits;
+    accumulator_size -= bits;
+}
+
+template<typename STREAM>
+inline
+bool BitReader<STREAM>::read_bits(uchar_t *buffer, size_t bits)
+{
+    last_count = 0;
+    while(bits)
+    {
+        // Only the last chunk may end in the middle of a byte
+        size_t chunk = bits < MAX_PEEK ? bits : MAX_PEEK;
+        uint64_t value = peek(chunk);
+        if(chunk > accumulator_size)
+        {
+            if(!overrun)
+                padded = accumulator_size < 8 && !(value & (((uint64_t) 1 << accumulator_size) - 1));
+
+            overrun = true;
+            chunk = accumulator_size;
+            bits = chunk;
+            if(!chunk)
+                break;
+        }
+
+        consume(chunk);
+        memcpy(buffer, &value, (chunk + 7) / 8);
+        last_count += (chunk + 7) / 8;
+        buffer += chunk / 8;
+        bits -= chunk;
+    }
+
+    return last_count;
+}
+
+template<typename STREAM>
+inline
+void BitReader<STREAM>::read(char *buffer, size_t bytes)
+{
+    if(accumulator_size % 8)
+    {
+        read_bits((uchar_t *) buffer, bytes * 8);
+        return;
+    }
+
+    // Whole bytes still in the accumulator go first
+    last_count = accumulator_size / 8 < bytes ? accumulator_size / 8 : bytes;
+    memcpy(buffer, &accumulator, last_count);
+    accumulator = last_count < 8 ? accumulator >> 8 * last_count : 0;
+    accumulator_size -= 8 * last_count;
+    buffer += last_count;
+    bytes -= last_count;
+
+    if(!bytes)
+        return;
+
+    // Bytes are taken past the accumulator, so it must not keep a stale
+    // copy of them
+    accumulator = 0;
+    while(bytes)
+    {
+        if(position == end)
+        {
+            // Large reads skip the buffer altogether
+            if(bytes >= input.size() && !eof)
+            {
+                stream.read(buffer, bytes);
+                size_t count = stream.gcount();
+                buffer += count;
+                last_count += count;
+                eof = count < bytes;
+                bytes -= count;
+                continue;
+            }
+
+            if(!fill())
+                break;
+        }
+
+        size_t count = end - position < bytes ? end - position : bytes;
+        memcpy(buffer, input.data() + position, count);
+        position += count;
+        buffer += count;
+        last_count += count;
+        bytes -= count;
+    }
+
+    if(bytes)
+        overrun = true;
+}
+
+template<typename STREAM>
+inline
+size_t BitReader<STREAM>::gcount(void) const
+{
+    return last_count;
+}
+
+// Counters of the stream underneath (an entropy coder)
+template<typename STREAM>
+inline
+void BitReader<STREAM>::collect(Stats &stats) const
+{
+    ::collect(stats, stream);
+}
+
+// Moves unread bytes to the front of the buffer and tops it up from the
+// stream. A short read means the stream ended, entropy decoders must not be
+// asked for more once they ran out of symbols.
+template<typename STREAM>
+inline
+bool BitReader<STREAM>::fill(void)
+{
+    if(eof)
+        return false;
+
+    memmove(input.data(), input.data() + position, end - position);
+    end -= position;
+    position = 0;
+    size_t wanted = input.size() - end;
+    stream.read((char *) input.data() + end, wanted);
+    size_t count = stream.gcount();
+    end += count;
+    eof = count < wanted;
+    return count;
+}
+
+template<typename STREAM>
+inline
+void BitReader<STREAM>::refill(void)
+{
+    if(end - position < 8)
+        fill();
+
+    if(end - position >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, input.data() + position, sizeof(word));
+        accumulator |= word << accumulator_size;
+        position += (63 - accumulator_size) / 8;
+        accumulator_size |= MAX_PEEK;
+        return;
+    }
+
+    while(accumulator_size <= MAX_PEEK && position < end)
+    {
+        accumulator |= (uint64_t) input[position ++] << accumulator_size;
+        accumulator_size += 8;
+    }
+}
+
+#endif // __BIT_READER_H__
@@ -0,0 +1,202 @@
+#ifndef __BIT_WRITER_H__
+#define __BIT_WRITER_H__
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "stats.h"
+
+typedef unsigned char uchar_t;
+
+// Writing counterpart of BitReader. Bits are gathered in a 64-bit
+// accumulator, whole bytes are moved to a staging buffer a word at a time
+// and the buffer goes to the underlying stream in one write once it is
+// full, so a stream that handles every byte separately (entropy coders)
+// sees few large writes instead of many small ones.
+template<typename STREAM>
+class BitWriter
+{
+    static const size_t MAX_APPEND = 56;
+
+    STREAM              stream;
+    std::vector<uchar_t> output;
+    size_t              fill;
+    uint64_t            accumulator;
+    size_t              accumulator_size;
+    size_t              last_count;
+
+public:
+    BitWriter(STREAM _stream, size_t _buffer_size=1U << 16);
+    ~BitWriter(void);
+
+    void flush(void);
+    void reset(void);
+    bool good(void) const;
+
+    void append(uint64_t value, size_t bits);
+
+    bool write_bits(uchar_t *buffer, size_t bits);
+    void write(char *buffer, size_t bytes);
+
+    size_t gcount(void) const;
+
+    void collect(Stats &stats) const;
+
+private:
+    void drain(void);
+    void flush_buffer(void);
+}; // class BitWriter
+
+template<typename STREAM>
+inline
+BitWriter<STREAM>::BitWriter(STREAM _stream, size_t _buffer_size)
+:stream{_stream}
+,output(_buffer_size)
+,fill{0}
+,accumulator{0}
+,accumulator_size{0}
+,last_count{0}
+{
+}
+
+template<typename STREAM>
+inline
+BitWriter<STREAM>::~BitWriter(void)
+{
+    flush();
+}
+
+// Pads the last byte with zeros and passes everything on to the stream
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::flush(void)
+{
+    drain();
+    if(accumulator_size)
+        output[fill ++] = accumulator;
+
+    accumulator = 0;
+    accumulator_size = 0;
+    flush_buffer();
+}
+
+// Drops whatever was not flushed, the stream itself is left alone
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::reset(void)
+{
+    fill = 0;
+    accumulator = 0;
+    accumulator_size = 0;
+    last_count = 0;
+}
+
+template<typename STREAM>
+inline
+bool BitWriter<STREAM>::good(void) const
+{
+    return stream.good();
+}
+
+// Lowest bits of value, at most MAX_APPEND of them
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::append(uint64_t value, size_t bits)
+{
+    assert(0 < bits && bits <= MAX_APPEND);
+    if(accumulator_size + bits > 64)
+        drain();
+
+    accumulator |= (value & (((uint64_t) 1 << bits) - 1)) << accumulator_size;
+    accumulator_size += bits;
+}
+
+template<typename STREAM>
+inline
+bool BitWriter<STREAM>::write_bits(uchar_t *buffer, size_t bits)
+{
+    last_count = (bits + 7) / 8;
+    while(bits)
+    {
+        // Only the last chunk may end in the middle of a byte
+        size_t chunk = bits < MAX_APPEND ? bits : MAX_APPEND;
+        uint64_t value = 0;
+        memcpy(&value, buffer, (chunk + 7) / 8);
+        append(value, chunk);
+        buffer += chunk / 8;
+        bits -= chunk;
+    }
+
+    return last_count;
+}
+
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::write(char *buffer, size_t bytes)
+{
+    if(accumulator_size % 8)
+    {
+        write_bits((uchar_t *) buffer, bytes * 8);
+        return;
+    }
+
+    drain();
+    last_count = bytes;
+    if(fill + bytes > output.size())
+        flush_buffer();
+
+    // Large writes skip the buffer altogether
+    if(bytes >= output.size())
+    {
+        stream.write(buffer, bytes);
+        return;
+    }
+
+    memcpy(output.data() + fill, buffer, bytes);
+    fill += bytes;
+}
+
+template<typename STREAM>
+inline
+size_t BitWriter<STREAM>::gcount(void) const
+{
+    return last_count;
+}
+
+// Counters of the stream underneath (an entropy coder)
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::collect(Stats &stats) const
+{
+    ::collect(stats, stream);
+}
+
+// Moves whole bytes from the accumulator to the buffer, leaves less than
+// a byte behind
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::drain(void)
+{
+    if(fill + sizeof(accumulator) > output.size())
+        flush_buffer();
+
+    size_t bytes = accumulator_size / 8;
+    memcpy(output.data() + fill, &accumulator, sizeof(accumulator));
+    fill += bytes;
+    accumulator = bytes < 8 ? accumulator >> 8 * bytes : 0;
+    accumulator_size -= 8 * bytes;
+}
+
+template<typename STREAM>
+inline
+void BitWriter<STREAM>::flush_buffer(void)
+{
+    if(fill)
+        stream.write((char *) output.data(), fill);
+
+    fill = 0;
+}
+
+#endif // __BIT_WRITER_H__
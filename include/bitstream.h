@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 typedef unsigned char uchar_t;
@@ -80,10 +81,14 @@ bool BitStream<STREAM, ACCUMULATOR>::write_bits(uchar_t *buffer, size_t bits)
     assert(accumulator_size < BITSPACE);
     while(bits >= BITSPACE && stream.good())
     {
-        accumulator |= (*(ACCUMULATOR *) buffer) << accumulator_size;
+        // Words are copied in and out of the byte buffer, it is not
+        // necessarily aligned for ACCUMULATOR
+        ACCUMULATOR word;
+        std::memcpy(&word, buffer, sizeof(word));
+        accumulator |= word << accumulator_size;
         stream.write((char *) &accumulator, sizeof(accumulator));
         last_count += sizeof(accumulator);
-        accumulator = (*(ACCUMULATOR *) buffer) >> (BITSPACE - accumulator_size);
+        accumulator = word >> (BITSPACE - accumulator_size);
         bits -= BITSPACE;
         buffer += sizeof(accumulator);
     }
@@ -146,7 +151,8 @@ bool BitStream<STREAM, ACCUMULATOR>::read_bits(uchar_t *buffer, size_t bits)
         if(stream.good())
         {
             last_count += stream.gcount();
-            *(ACCUMULATOR *&) buffer = accumulator | (input << accumulator_size);
+            ACCUMULATOR word = accumulator | (input << accumulator_size);
+            std::memcpy(buffer, &word, sizeof(word));
             accumulator = input >> (BITSPACE - accumulator_size);
             bits -= BITSPACE;
             buffer += sizeof(accumulator);
@@ -173,7 +179,9 @@ bool BitStream<STREAM, ACCUMULATOR>::read_bits(uchar_t *buffer, size_t bits)
         stream.read((char *) &input, sizeof(input));
         if(stream.good())
         {
-            *(ACCUMULATOR *&) buffer = (accumulator | (((ACCUMULATOR) input) << accumulator_size)) & (((ACCUMULATOR) 1 << bits) - 1);
+            // Only the bytes holding the last bits, buffer may end there
+            ACCUMULATOR word = (accumulator | (((ACCUMULATOR) input) << accumulator_size)) & (((ACCUMULATOR) 1 << bits) - 1);
+            std::memcpy(buffer, &word, (bits + 7) / 8);
             last_count += (bits + 7) / 8;
             accumulator = input >> (BITSPACE - accumulator_size);
             accumulator_size = accumulator_size + 8 - BITSPACE;
@@ -0,0 +1,505 @@
+#ifndef __CANONICAL_HUFFMAN_H__
+#define __CANONICAL_HUFFMAN_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+typedef unsigned char uchar_t;
+
+// Block-static Huffman coding with canonical codes.
+//
+// Encoder buffers up to block_size bytes, builds Huffman code for them
+// (limited to MAX_LENGTH bits) and writes the block as:
+//      32 bits     number of bytes in block (0 marks end of data)
+//      256 x 4     code length of every byte value (0 - not present)
+//      ...         codes, bits of every code reversed so decoder can index
+//                  table straight with next MAX_LENGTH bits of input
+//
+// Decoder only rebuilds one lookup table per block, every byte is a single
+// table access.
+template<typename BITSTREAM>
+class CanonicalHuffman
+{
+public:
+    static const uint32_t   BLOCK_SIZE = 1U << 17;
+
+private:
+    static const size_t     MAX_LENGTH = 12;
+    static const size_t     TABLE_SIZE = 1 << MAX_LENGTH;
+    static const size_t     COUNT_BITS = 32;
+    static const size_t     LENGTH_BITS = 4;
+
+    BITSTREAM               stream;
+    size_t                  block_size;
+
+    // Encoder state
+    std::vector<uchar_t>    block;
+    std::vector<uchar_t>    output;
+    bool                    written;
+
+    // Decoder state
+    std::vector<uint16_t>   table; // byte | length << 8
+    uint32_t                remaining;
+    bool                    finished;
+    bool                    corrupted;
+
+    // Bits waiting to be written or read, LSB first
+    uint64_t    bits;
+    size_t      bits_size;
+    bool        eof;
+    bool        overrun;
+
+    size_t      last_count;
+
+public:
+    CanonicalHuffman(BITSTREAM _stream, size_t _block_size=BLOCK_SIZE);
+    ~CanonicalHuffman(void);
+
+    void flush(void);
+    bool good(void) const;
+
+    void write(char *buffer, size_t bytes);
+    void read(char *buffer, size_t bytes);
+
+    bool put(uchar_t byte);
+    bool get(char &byte);
+
+    size_t gcount(void) const;
+
+private:
+    void encode_block(void);
+    void append(uint64_t value, size_t count);
+    void drain(void);
+
+    bool decode_header(void);
+    void refill(void);
+    void consume(size_t count);
+
+    static void build_lengths(const uint64_t *frequency, uchar_t *length);
+    static void build_codes(const uchar_t *length, uint16_t *code);
+    static uint16_t reverse(uint16_t code, size_t length);
+}; // class CanonicalHuffman
+
+template<typename BITSTREAM>
+inline
+CanonicalHuffman<BITSTREAM>::CanonicalHuffman(BITSTREAM _stream, size_t _block_size)
+:stream{_stream}
+,block_size{_block_size}
+,block{}
+,output{}
+,written{false}
+,table{}
+,remaining{0}
+,finished{false}
+,corrupted{false}
+,bits{0}
+,bits_size{0}
+,eof{false}
+,overrun{false}
+,last_count{0}
+{
+    assert(block_size && block_size < ((uint64_t) 1 << COUNT_BITS));
+}
+
+template<typename BITSTREAM>
+inline
+CanonicalHuffman<BITSTREAM>::~CanonicalHuffman(void)
+{
+    flush();
+}
+
+// Writes buffered bytes as last block followed by end of data marker.
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::flush(void)
+{
+    if(!block.empty())
+        encode_block();
+
+    if(!written)
+        return;
+
+    append(0, COUNT_BITS);
+    if(bits_size)
+    {
+        output.push_back(bits);
+        bits = bits_size = 0;
+    }
+
+    drain();
+    written = false;
+}
+
+template<typename BITSTREAM>
+inline
+bool CanonicalHuffman<BITSTREAM>::good(void) const
+{
+    if(finished || corrupted)
+        return false;
+
+    // Running out of input while reading ahead is not an error until the
+    // missing bits are actually needed
+    if(eof)
+        return !overrun;
+
+    return stream.good();
+}
+
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::write(char *buffer, size_t bytes)
+{
+    last_count = 0;
+    size_t count = bytes;
+    while(bytes)
+    {
+        if(block.capacity() < block_size)
+            block.reserve(block_size);
+
+        size_t chunk = std::min(bytes, block_size - block.size());
+        block.insert(end(block), buffer, buffer + chunk);
+        buffer += chunk;
+        bytes -= chunk;
+        if(block.size() == block_size)
+            encode_block();
+    }
+
+    last_count = count;
+}
+
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::read(char *buffer, size_t bytes)
+{
+    last_count = 0;
+    size_t count = bytes;
+    while(bytes --)
+        if(!get(*buffer ++))
+        {
+            last_count = count - bytes - 1;
+            return;
+        }
+
+    last_count = count;
+}
+
+template<typename BITSTREAM>
+inline
+bool CanonicalHuffman<BITSTREAM>::put(uchar_t byte)
+{
+    write((char *) &byte, 1);
+    return true;
+}
+
+template<typename BITSTREAM>
+inline
+bool CanonicalHuffman<BITSTREAM>::get(char &byte)
+{
+    last_count = 0;
+    if(!remaining && !decode_header())
+        return false;
+
+    if(bits_size < MAX_LENGTH)
+        refill();
+
+    const uint16_t entry = table[bits & (TABLE_SIZE - 1)];
+    if(!(entry >> 8))
+    {
+        corrupted = true;
+        return false;
+    }
+
+    consume(entry >> 8);
+    if(overrun)
+        return false;
+
+    byte = entry & 0xFF;
+    -- remaining;
+    last_count = 1;
+    return true;
+}
+
+template<typename BITSTREAM>
+inline
+size_t CanonicalHuffman<BITSTREAM>::gcount(void) const
+{
+    return last_count;
+}
+
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::encode_block(void)
+{
+    uint64_t frequency[256] = {};
+    for(uchar_t byte: block)
+        ++ frequency[byte];
+
+    uchar_t length[256];
+    uint16_t code[256];
+    build_lengths(frequency, length);
+    build_codes(length, code);
+
+    append(block.size(), COUNT_BITS);
+    for(size_t b = 0; b < 256; ++ b)
+        append(length[b], LENGTH_BITS);
+
+    for(uchar_t byte: block)
+        append(code[byte], length[byte]);
+
+    drain();
+    block.clear();
+    written = true;
+}
+
+// Adds count (at most 32) lowest bits of value to the output, whole bytes
+// are moved to the output buffer right away.
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::append(uint64_t value, size_t count)
+{
+    assert(count <= 32);
+    bits |= value << bits_size;
+    bits_size += count;
+    while(bits_size >= 8)
+    {
+        output.push_back(bits);
+        bits >>= 8;
+        bits_size -= 8;
+    }
+}
+
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::drain(void)
+{
+    if(output.empty())
+        return;
+
+    stream.write((char *) output.data(), output.size());
+    output.clear();
+}
+
+// Reads next block header and prepares decoding table for it. End of data
+// marker or missing header finishes decoding, blocks bigger than the
+// encoder could have made are corrupted.
+template<typename BITSTREAM>
+inline
+bool CanonicalHuffman<BITSTREAM>::decode_header(void)
+{
+    if(finished || corrupted)
+        return false;
+
+    if(bits_size < COUNT_BITS)
+        refill();
+
+    if(bits_size < COUNT_BITS)
+    {
+        finished = true;
+        return false;
+    }
+
+    remaining = bits & 0xFFFFFFFFU;
+    consume(COUNT_BITS);
+    if(!remaining)
+    {
+        finished = true;
+        return false;
+    }
+
+    if(remaining > block_size)
+    {
+        corrupted = true;
+        return false;
+    }
+
+    uchar_t length[256];
+    size_t space = 0;
+    for(size_t b = 0; b < 256; ++ b)
+    {
+        if(bits_size < LENGTH_BITS)
+            refill();
+
+        length[b] = bits & ((1U << LENGTH_BITS) - 1);
+        consume(LENGTH_BITS);
+        if(length[b] > MAX_LENGTH)
+            corrupted = true;
+
+        else if(length[b])
+            space += TABLE_SIZE >> length[b];
+    }
+
+    // Code lengths have to describe a prefix code
+    if(overrun || corrupted || !space || space > TABLE_SIZE)
+    {
+        corrupted = true;
+        return false;
+    }
+
+    uint16_t code[256];
+    build_codes(length, code);
+    table.assign(TABLE_SIZE, 0);
+    for(size_t b = 0; b < 256; ++ b)
+        for(size_t index = code[b]; length[b] && index < TABLE_SIZE; index += 1U << length[b])
+            table[index] = b | length[b] << 8;
+
+    return true;
+}
+
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::refill(void)
+{
+    while(bits_size + 8 <= 64 && !eof)
+    {
+        uchar_t input[8];
+        size_t wanted = (64 - bits_size) / 8;
+        stream.read((char *) input, wanted);
+        size_t count = stream.gcount();
+        for(size_t i = 0; i < count; ++ i)
+        {
+            bits |= (uint64_t) input[i] << bits_size;
+            bits_size += 8;
+        }
+
+        eof = count < wanted;
+    }
+}
+
+// Past the end of input all bits read as zero
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::consume(size_t count)
+{
+    if(count > bits_size)
+    {
+        overrun = true;
+        count = bits_size;
+    }
+
+    bits = count < 64 ? bits >> count : 0;
+    bits_size -= count;
+}
+
+// Huffman code lengths for given byte frequencies, none longer than
+// MAX_LENGTH. Absent bytes get length 0, a single present byte length 1.
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::build_lengths(const uint64_t *frequency, uchar_t *length)
+{
+    std::fill(length, length + 256, 0);
+    std::vector<uint16_t> symbols;
+    for(size_t b = 0; b < 256; ++ b)
+        if(frequency[b])
+            symbols.push_back(b);
+
+    const size_t leaves = symbols.size();
+    if(leaves < 2)
+    {
+        if(leaves)
+            length[symbols[0]] = 1;
+
+        return;
+    }
+
+    std::stable_sort(begin(symbols), end(symbols), [&](uint16_t a, uint16_t b) {
+        return frequency[a] < frequency[b];
+    });
+
+    // Two queue construction: leaves sorted by weight and internal nodes
+    // created in nondecreasing order of weight
+    std::vector<uint64_t> weight(2 * leaves - 1);
+    std::vector<uint16_t> parent(2 * leaves - 1);
+    for(size_t l = 0; l < leaves; ++ l)
+        weight[l] = frequency[symbols[l]];
+
+    size_t leaf = 0;
+    size_t node = leaves;
+    for(size_t next = leaves; next < 2 * leaves - 1; ++ next)
+    {
+        weight[next] = 0;
+        for(size_t child = 0; child < 2; ++ child)
+        {
+            size_t smallest = leaf < leaves && (node == next || weight[leaf] <= weight[node]) ? leaf ++ : node ++;
+            weight[next] += weight[smallest];
+            parent[smallest] = next;
+        }
+    }
+
+    size_t count[64] = {};
+    std::vector<uchar_t> depth(2 * leaves - 1);
+    depth[2 * leaves - 2] = 0;
+    for(size_t n = 2 * leaves - 2; n --; )
+    {
+        depth[n] = depth[parent[n]] + 1;
+        if(n < leaves)
+            ++ count[depth[n] < MAX_LENGTH ? depth[n] : MAX_LENGTH];
+    }
+
+    // Clamping too long codes broke Kraft's inequality, lengthen shorter
+    // codes until it holds again
+    size_t total = 0;
+    for(size_t l = 1; l <= MAX_LENGTH; ++ l)
+        total += count[l] << (MAX_LENGTH - l);
+
+    while(total > TABLE_SIZE)
+    {
+        -- count[MAX_LENGTH];
+        for(size_t l = MAX_LENGTH - 1; l; -- l)
+            if(count[l])
+            {
+                -- count[l];
+                count[l + 1] += 2;
+                break;
+            }
+
+        -- total;
+    }
+
+    // Most frequent bytes get shortest codes
+    size_t l = 1;
+    for(size_t s = leaves; s --; )
+    {
+        while(!count[l])
+            ++ l;
+
+        length[symbols[s]] = l;
+        -- count[l];
+    }
+}
+
+// Canonical code for every byte (ordered by length, then by value), bit
+// reversed for LSB first output.
+template<typename BITSTREAM>
+inline
+void CanonicalHuffman<BITSTREAM>::build_codes(const uchar_t *length, uint16_t *code)
+{
+    uint16_t count[MAX_LENGTH + 1] = {};
+    for(size_t b = 0; b < 256; ++ b)
+        ++ count[length[b]];
+
+    count[0] = 0;
+    uint16_t next[MAX_LENGTH + 1] = {};
+    for(size_t l = 1; l <= MAX_LENGTH; ++ l)
+        next[l] = (next[l - 1] + count[l - 1]) << 1;
+
+    for(size_t b = 0; b < 256; ++ b)
+        code[b] = length[b] ? reverse(next[length[b]] ++, length[b]) : 0;
+}
+
+template<typename BITSTREAM>
+inline
+uint16_t CanonicalHuffman<BITSTREAM>::reverse(uint16_t code, size_t length)
+{
+    uint16_t result = 0;
+    while(length --)
+    {
+        result = result << 1 | (code & 1);
+        code >>= 1;
+    }
+
+    return result;
+}
+
+#endif // __CANONICAL_HUFFMAN_H__
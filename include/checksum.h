@@ -0,0 +1,144 @@
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+typedef unsigned char uchar_t;
+
+// Adler-32 (RFC 1950), modulo is taken only once per NMAX bytes.
+class Adler32
+{
+    static const uint32_t   BASE = 65521;
+    static const size_t     NMAX = 5552;
+
+    uint32_t    a;
+    uint32_t    b;
+
+public:
+    Adler32(void);
+
+    void update(const uchar_t *buffer, size_t bytes);
+    uint32_t value(void) const;
+}; // class Adler32
+
+inline
+Adler32::Adler32(void)
+:a{1}
+,b{0}
+{
+}
+
+inline
+void Adler32::update(const uchar_t *buffer, size_t bytes)
+{
+    while(bytes)
+    {
+        size_t chunk = bytes < NMAX ? bytes : NMAX;
+        bytes -= chunk;
+        while(chunk --)
+        {
+            a += *buffer ++;
+            b += a;
+        }
+
+        a %= BASE;
+        b %= BASE;
+    }
+}
+
+inline
+uint32_t Adler32::value(void) const
+{
+    return b << 16 | a;
+}
+
+// Stream buffer counting and checksumming everything read from or written
+// to another stream buffer. Written data is dropped if there is no target,
+// which lets integrity checks run without producing output.
+class ChecksumBuffer: public std::streambuf
+{
+    std::streambuf      *target;
+    std::vector<char>   buffer;
+    Adler32             checksum;
+    uint64_t            length;
+
+public:
+    ChecksumBuffer(std::streambuf *_target, size_t _buffer_size=1U << 16);
+
+    uint64_t size(void) const;
+    uint32_t value(void) const;
+
+protected:
+    int_type underflow(void) override;
+    int_type overflow(int_type character) override;
+    std::streamsize xsputn(const char *data, std::streamsize bytes) override;
+    int sync(void) override;
+}; // class ChecksumBuffer
+
+inline
+ChecksumBuffer::ChecksumBuffer(std::streambuf *_target, size_t _buffer_size)
+:target{_target}
+,buffer(_buffer_size)
+,checksum{}
+,length{0}
+{
+}
+
+inline
+uint64_t ChecksumBuffer::size(void) const
+{
+    return length;
+}
+
+inline
+uint32_t ChecksumBuffer::value(void) const
+{
+    return checksum.value();
+}
+
+inline
+ChecksumBuffer::int_type ChecksumBuffer::underflow(void)
+{
+    if(!target)
+        return traits_type::eof();
+
+    std::streamsize count = target->sgetn(buffer.data(), buffer.size());
+    if(count <= 0)
+        return traits_type::eof();
+
+    checksum.update((uchar_t *) buffer.data(), count);
+    length += count;
+    setg(buffer.data(), buffer.data(), buffer.data() + count);
+    return traits_type::to_int_type(*gptr());
+}
+
+inline
+ChecksumBuffer::int_type ChecksumBuffer::overflow(int_type character)
+{
+    if(traits_type::eq_int_type(character, traits_type::eof()))
+        return traits_type::not_eof(character);
+
+    char byte = traits_type::to_char_type(character);
+    return xsputn(&byte, 1) == 1 ? character : traits_type::eof();
+}
+
+inline
+std::streamsize ChecksumBuffer::xsputn(const char *data, std::streamsize bytes)
+{
+    if(target && target->sputn(data, bytes) != bytes)
+        return 0;
+
+    checksum.update((const uchar_t *) data, bytes);
+    length += bytes;
+    return bytes;
+}
+
+inline
+int ChecksumBuffer::sync(void)
+{
+    return target ? target->pubsync() : 0;
+}
+
+#endif // __CHECKSUM_H__
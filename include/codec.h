@@ -0,0 +1,270 @@
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#include "adaptive_huffman.h"
+#include "bit_reader.h"
+#include "bit_writer.h"
+#include "decoding_dictionary.h"
+#include "dictionary.h"
+#include "memory_stream.h"
+#include "preset.h"
+#include "lz78/lz78.h"
+#include "lzw/lzw.h"
+
+// Buffer to buffer (de)compression of many small messages.
+//
+// A context keeps the dictionary, the FGK tree and every stream buffer
+// between calls and only resets them, so once its buffers have grown to the
+// size of the messages a call allocates nothing. A compressed message is
+// exactly the body of an unframed (-B 0) stream: LZ codes through FGK,
+// without header, trailer or checksum. Both sides must use the same
+// dictionary size, and the same preset if any (LZW only). The preset must
+// outlive the context.
+//
+//      LZWContext context{16};
+//      size_t size = lzw_compress(context, input, input_size, output, capacity);
+//      if(size == CODEC_ERROR)
+//          ... output too small
+//
+// A context is not thread safe, use one per thread.
+const size_t CODEC_ERROR = ~(size_t) 0;
+
+// Library calls have nowhere to log to
+struct SilentLog
+{
+    enum LOG_LEVEL: uint8_t
+    {
+        DEBUG,
+        INFO,
+        WARNING,
+        ERROR,
+    }; // enum LOG_LEVEL
+
+    struct Line
+    {
+        template<typename TYPE>
+        Line &operator<<(const TYPE &) { return *this; }
+    }; // struct Line
+
+    bool enabled(LOG_LEVEL) const { return false; }
+    Line operator()(LOG_LEVEL) { return {}; }
+}; // struct SilentLog
+
+// Dictionaries that can start from a preset take it as the first argument
+template<typename DICTIONARY>
+DICTIONARY make_dictionary(const Preset *preset, size_t dict_size, std::true_type)
+{
+    return DICTIONARY{preset, dict_size};
+}
+
+template<typename DICTIONARY>
+DICTIONARY make_dictionary(const Preset *, size_t dict_size, std::false_type)
+{
+    return DICTIONARY{dict_size};
+}
+
+template<typename DICTIONARY>
+using takes_preset = std::is_constructible<DICTIONARY, const Preset *, size_t>;
+
+// Every layer is owned here and the codec only refers to it, so each one
+// can be reset and flushed on its own
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+class Encoder
+{
+    typedef BitWriter<MemorySink &>     Bytes;
+    typedef AdaptiveHuffman<Bytes &>    Huffman;
+    typedef BitWriter<Huffman &>        Codes;
+
+    MemorySink  sink;
+    Bytes       bytes;
+    Huffman     huffman;
+    Codes       codes;
+    CODEC<SilentLog, DICTIONARY, Codes &> codec;
+
+public:
+    Encoder(size_t _dict_size, const Preset *_preset);
+
+    size_t run(const uchar_t *input, size_t size, uchar_t *output, size_t capacity);
+}; // class Encoder
+
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+class Decoder
+{
+    typedef BitReader<MemorySource &>   Bytes;
+    typedef AdaptiveHuffman<Bytes &>    Huffman;
+    typedef BitReader<Huffman &>        Codes;
+    typedef BitWriter<MemorySink &>     Output;
+
+    MemorySource    source;
+    Bytes           bytes;
+    Huffman         huffman;
+    Codes           codes;
+    MemorySink      sink;
+    Output          output;
+    CODEC<SilentLog, DICTIONARY, Output &> codec;
+
+public:
+    Decoder(size_t _dict_size, const Preset *_preset);
+
+    size_t run(const uchar_t *input, size_t size, uchar_t *output, size_t capacity);
+}; // class Decoder
+
+// Encoder and decoder are set up on first use, a context that only
+// compresses never allocates a decoding dictionary. LAG is the number of
+// elements the decoder adds late (LZW adds each one a code late).
+template<template<typename, typename, typename> class CODEC, typename ENCODING, typename DECODING, size_t LAG>
+class Context
+{
+    size_t  dict_size;
+    const Preset *preset;
+    std::unique_ptr<Encoder<CODEC, ENCODING>> encoder;
+    std::unique_ptr<Decoder<CODEC, DECODING>> decoder;
+
+public:
+    Context(size_t bit_size=20, const Preset *_preset=nullptr);
+
+    size_t compress(const uchar_t *input, size_t size, uchar_t *output, size_t capacity);
+    size_t decompress(const uchar_t *input, size_t size, uchar_t *output, size_t capacity);
+}; // class Context
+
+typedef Context<LZW, PresetDictionary<>, PresetDictionary<DecodingDictionary>, 1> LZWContext;
+typedef Context<LZ78, Dictionary, DecodingDictionary, 0> LZ78Context;
+
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+inline
+Encoder<CODEC, DICTIONARY>::Encoder(size_t _dict_size, const Preset *_preset)
+:sink{}
+,bytes{sink}
+,huffman{bytes, _preset ? _preset->counts.data() : nullptr}
+,codes{huffman}
+,codec{SilentLog{}, make_dictionary<DICTIONARY>(_preset, _dict_size, takes_preset<DICTIONARY>{}), codes}
+{
+}
+
+// Size of the compressed message, CODEC_ERROR when it does not fit
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+inline
+size_t Encoder<CODEC, DICTIONARY>::run(const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    sink.reset(output, capacity);
+    bytes.reset();
+    huffman.reset();
+    codes.reset();
+    codec.reset();
+
+    codec.compress(MemorySource{input, size});
+    codec.flush();
+    codes.flush();
+    huffman.flush();
+    bytes.flush();
+
+    size_t result = sink.good() && codec.good() ? sink.size() : CODEC_ERROR;
+    sink.reset(nullptr, 0);
+    return result;
+}
+
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+inline
+Decoder<CODEC, DICTIONARY>::Decoder(size_t _dict_size, const Preset *_preset)
+:source{}
+,bytes{source}
+,huffman{bytes, _preset ? _preset->counts.data() : nullptr}
+,codes{huffman}
+,sink{}
+,output{sink}
+,codec{SilentLog{}, make_dictionary<DICTIONARY>(_preset, _dict_size, takes_preset<DICTIONARY>{}), output}
+{
+}
+
+// Size of the decompressed message, CODEC_ERROR when it does not fit or is
+// not a whole message. Messages have no checksum, so a complete one is one
+// where both the LZ codes and FGK end cleanly: the last code is followed
+// only by padding, exactly where FGK finds the escape ending the data.
+// Only an empty message has no escape.
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY>
+inline
+size_t Decoder<CODEC, DICTIONARY>::run(const uchar_t *input, size_t size, uchar_t *_output, size_t capacity)
+{
+    source.reset(input, size);
+    sink.reset(_output, capacity);
+    bytes.reset();
+    huffman.reset();
+    codes.reset();
+    output.reset();
+    codec.reset();
+
+    codec.template decompress<Codes &>(codes);
+    output.flush();
+
+    bool complete = !size || (codes.ended() && huffman.ended());
+    size_t result = complete && sink.good() && codec.good() ? sink.size() : CODEC_ERROR;
+    source.reset(nullptr, 0);
+    sink.reset(nullptr, 0);
+    return result;
+}
+
+template<template<typename, typename, typename> class CODEC, typename ENCODING, typename DECODING, size_t LAG>
+inline
+Context<CODEC, ENCODING, DECODING, LAG>::Context(size_t bit_size, const Preset *_preset)
+:dict_size{(size_t) 1 << bit_size}
+,preset{_preset}
+,encoder{}
+,decoder{}
+{
+    if(bit_size < 15 || bit_size > 31)
+        throw std::runtime_error("Invalid bit_size for dictionary");
+
+    if(preset && !takes_preset<ENCODING>::value)
+        throw std::runtime_error("Codec cannot start from a preset dictionary");
+}
+
+template<template<typename, typename, typename> class CODEC, typename ENCODING, typename DECODING, size_t LAG>
+inline
+size_t Context<CODEC, ENCODING, DECODING, LAG>::compress(const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    if(!encoder)
+        encoder.reset(new Encoder<CODEC, ENCODING>{dict_size, preset});
+
+    return encoder->run(input, size, output, capacity);
+}
+
+template<template<typename, typename, typename> class CODEC, typename ENCODING, typename DECODING, size_t LAG>
+inline
+size_t Context<CODEC, ENCODING, DECODING, LAG>::decompress(const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    if(!decoder)
+        decoder.reset(new Decoder<CODEC, DECODING>{dict_size - LAG * sizeof(Element), preset});
+
+    return decoder->run(input, size, output, capacity);
+}
+
+inline
+size_t lzw_compress(LZWContext &context, const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    return context.compress(input, size, output, capacity);
+}
+
+inline
+size_t lzw_decompress(LZWContext &context, const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    return context.decompress(input, size, output, capacity);
+}
+
+inline
+size_t lz78_compress(LZ78Context &context, const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    return context.compress(input, size, output, capacity);
+}
+
+inline
+size_t lz78_decompress(LZ78Context &context, const uchar_t *input, size_t size, uchar_t *output, size_t capacity)
+{
+    return context.decompress(input, size, output, capacity);
+}
+
+#endif // __CODEC_H__
@@ -0,0 +1,164 @@
+#ifndef __DECODING_DICTIONARY_H__
+#define __DECODING_DICTIONARY_H__
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "dictionary.h"
+
+// Dictionary for decompression only. Decoders never search for suffixes,
+// they only add elements and follow prefix chains, so there is no
+// next/left/right search tree - an element is just its prefix and last
+// byte. Phrase lengths and offsets are kept by History.
+//
+// Numbering and reset points are the same as in Dictionary, the size limit
+// is still counted in Elements. Unlike Dictionary, adding a suffix that is
+// already present creates a second element, encoders never emit codes that
+// would do that (except for the last LZ78 code, after which nothing is
+// added anymore).
+class DecodingDictionary
+{
+protected:
+    std::vector<uchar_t>    byte;
+    std::vector<uint32_t>   prev; // prefix
+
+    size_t size_limit;
+    uint32_t current;
+
+    Resets                  resets; // for Stats
+
+public:
+    DecodingDictionary(size_t _size_limit);
+    void step_back(uchar_t &byte, size_t &id);
+    void select(size_t id);
+    void add_suffix(uchar_t byte);
+    void recycle(size_t id, uchar_t byte);
+    virtual void clear(void);
+    size_t size(void) const;
+    bool empty(void) const;
+    bool full(void) const; // next add_suffix would clear
+
+    uchar_t get_byte(size_t id) const;
+    size_t get_prev(size_t id) const;
+
+    void collect(Stats &stats) const;
+
+protected:
+    bool is_valid(uint32_t id) const
+    {
+        return 0 < id && id <= byte.size();
+    }
+
+    void truncate(size_t size);
+}; // class DecodingDictionary
+
+inline
+DecodingDictionary::DecodingDictionary(size_t _size_limit)
+:byte{}
+,prev{}
+,size_limit{_size_limit}
+,current{0}
+,resets{}
+{
+    byte.reserve(size_limit / sizeof(Element));
+    prev.reserve(size_limit / sizeof(Element));
+}
+
+inline
+void DecodingDictionary::step_back(uchar_t &_byte, size_t &id)
+{
+    assert(is_valid(current));
+    _byte = byte[current - 1];
+    id = current = prev[current - 1];
+}
+
+inline
+void DecodingDictionary::select(size_t id)
+{
+    assert(!id || is_valid(id));
+    current = id;
+}
+
+inline
+void DecodingDictionary::add_suffix(uchar_t _byte)
+{
+    if(full())
+    {
+        clear();
+        return;
+    }
+
+    prev.push_back(is_valid(current) ? current : 0);
+    byte.push_back(_byte);
+    current = 0;
+}
+
+// Element id becomes suffix byte of the current element, nothing links to
+// it anymore so its old phrase just disappears
+inline
+void DecodingDictionary::recycle(size_t id, uchar_t _byte)
+{
+    assert(is_valid(id) && is_valid(current) && id != current);
+    byte[id - 1] = _byte;
+    prev[id - 1] = current;
+    current = 0;
+}
+
+inline
+void DecodingDictionary::clear(void)
+{
+    resets.add(size());
+    current = 0;
+    byte.clear();
+    prev.clear();
+}
+
+inline
+void DecodingDictionary::truncate(size_t size)
+{
+    resets.add(this->size());
+    current = 0;
+    byte.resize(size);
+    prev.resize(size);
+}
+
+inline
+size_t DecodingDictionary::size(void) const
+{
+    return byte.size();
+}
+
+inline
+bool DecodingDictionary::empty(void) const
+{
+    return !size();
+}
+
+inline
+bool DecodingDictionary::full(void) const
+{
+    return (size() + 1) * sizeof(Element) > size_limit;
+}
+
+inline
+uchar_t DecodingDictionary::get_byte(size_t id) const
+{
+    assert(is_valid(id));
+    return byte[id - 1];
+}
+
+inline
+size_t DecodingDictionary::get_prev(size_t id) const
+{
+    assert(is_valid(id));
+    return prev[id - 1];
+}
+
+inline
+void DecodingDictionary::collect(Stats &stats) const
+{
+    stats.resets.merge(resets);
+}
+
+#endif // __DECODING_DICTIONARY_H__
@@ -5,8 +5,12 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <vector>
 
+#include "arena.h"
+#include "stats.h"
+
 typedef unsigned char uchar_t;
 
 struct Element
@@ -18,13 +22,34 @@ struct Element
     uint32_t    right;
 }; // struct Element
 
+// Structure of arrays layout. Arrays come from the arena when there is one.
+// Capacity survives clear(), so a dictionary reset reuses the same (already
+// touched) pages.
 struct Memory
 {
-    std::vector<uchar_t>    byte;
-    std::vector<uint32_t>   prev; // prefix
-    std::vector<uint32_t>   next; // first suffix
-    std::vector<uint32_t>   left; // tree with same prefix
-    std::vector<uint32_t>   right; // tree with same prefix
+    template<typename TYPE>
+    using Array = std::vector<TYPE, ArenaAllocator<TYPE>>;
+
+    Array<uchar_t>  byte;
+    Array<uint32_t> prev; // prefix
+    Array<uint32_t> next; // first suffix
+    Array<uint32_t> left; // tree with same prefix
+    Array<uint32_t> right; // tree with same prefix
+
+    Memory(std::shared_ptr<Arena> arena=nullptr)
+    :byte{ArenaAllocator<uchar_t>{arena}}
+    ,prev{ArenaAllocator<uint32_t>{arena}}
+    ,next{ArenaAllocator<uint32_t>{arena}}
+    ,left{ArenaAllocator<uint32_t>{arena}}
+    ,right{ArenaAllocator<uint32_t>{arena}}
+    {
+    }
+
+    // Arena size needed to reserve size elements
+    static size_t footprint(size_t size)
+    {
+        return size * (sizeof(uchar_t) + 4 * sizeof(uint32_t)) + 5 * Arena::ALIGNMENT;
+    }
 
     void reserve(size_t size)
     {
@@ -71,42 +96,211 @@ struct Memory
         right.clear();
     }
 
-    void resize(size_t size)
+    // Elements below size only lose their links to dropped ones. New
+    // elements always hang below older ones in a suffix tree, so no kept
+    // element goes with them.
+    void truncate(size_t size)
     {
         byte.resize(size);
         prev.resize(size);
         next.resize(size);
         left.resize(size);
         right.resize(size);
+        for(size_t index = 0; index < size; ++ index)
+        {
+            next[index] = next[index] > size ? 0 : next[index];
+            left[index] = left[index] > size ? 0 : left[index];
+            right[index] = right[index] > size ? 0 : right[index];
+        }
     }
 
-    void emplace_back(uchar_t _byte, uint32_t _prev, uint32_t _next=0, uint32_t _left=0, uint32_t _right=0)
+    void emplace_back(uchar_t _byte, uint32_t _prev)
     {
         byte.emplace_back(_byte);
         prev.emplace_back(_prev);
-        next.emplace_back(_next);
-        left.emplace_back(_left);
-        right.emplace_back(_right);
+        next.emplace_back(0);
+        left.emplace_back(0);
+        right.emplace_back(0);
     }
+
+    void assign(size_t index, uchar_t _byte, uint32_t _prev)
+    {
+        byte[index] = _byte;
+        prev[index] = _prev;
+        next[index] = 0;
+        left[index] = 0;
+        right[index] = 0;
+    }
+
+    uchar_t get_byte(size_t index) const { return byte[index]; }
+    uint32_t get_prev(size_t index) const { return prev[index]; }
+    uint32_t get_next(size_t index) const { return next[index]; }
+    uint32_t get_left(size_t index) const { return left[index]; }
+    uint32_t get_right(size_t index) const { return right[index]; }
+
+    void set_next(size_t index, uint32_t value) { next[index] = value; }
+    void set_left(size_t index, uint32_t value) { left[index] = value; }
+    void set_right(size_t index, uint32_t value) { right[index] = value; }
 }; // struct Memory
 
-class Dictionary
+// Array of structs layout. Everything a search step reads (byte, left,
+// right) and next sit in one 16 byte node, so a hop touches a single cache
+// line; prev is only needed when walking back and lives apart. Nodes are
+// stamped with the generation in which their next was set, truncate() just
+// starts a new generation instead of zeroing next of every kept node, and
+// carries over only the ones that link to other kept nodes.
+struct PackedMemory
+{
+    struct Node
+    {
+        uint32_t    next; // first suffix, valid in its generation only
+        uint32_t    left; // tree with same prefix
+        uint32_t    right; // tree with same prefix
+        uchar_t     byte;
+        uchar_t     unused;
+        uint16_t    generation;
+    }; // struct Node
+
+    static_assert(sizeof(Node) == 16, "Node must fill a quarter of a cache line");
+
+    template<typename TYPE>
+    using Array = std::vector<TYPE, ArenaAllocator<TYPE>>;
+
+    Array<Node>     node;
+    Array<uint32_t> prev; // prefix
+    uint16_t        generation;
+
+    PackedMemory(std::shared_ptr<Arena> arena=nullptr)
+    :node{ArenaAllocator<Node>{arena}}
+    ,prev{ArenaAllocator<uint32_t>{arena}}
+    ,generation{0}
+    {
+    }
+
+    static size_t footprint(size_t size)
+    {
+        return size * (sizeof(Node) + sizeof(uint32_t)) + 2 * Arena::ALIGNMENT;
+    }
+
+    void reserve(size_t size)
+    {
+        node.reserve(size);
+        prev.reserve(size);
+    }
+
+    size_t size(void) const
+    {
+        assert(node.size() == prev.size());
+        return node.size();
+    }
+
+    size_t capacity(void) const
+    {
+        assert(node.capacity() == prev.capacity());
+        return node.capacity();
+    }
+
+    bool empty(void) const
+    {
+        assert(node.empty() == prev.empty());
+        return node.empty();
+    }
+
+    void clear(void)
+    {
+        node.clear();
+        prev.clear();
+    }
+
+    void truncate(size_t size)
+    {
+        node.resize(size);
+        prev.resize(size);
+        uint16_t kept = generation ++;
+        for(Node &element: node)
+        {
+            if(element.generation == kept && element.next <= size)
+                element.generation = generation;
+
+            // Stamps from 2^16 truncates ago would look current again
+            else if(!generation)
+            {
+                element.next = 0;
+                element.generation = 0;
+            }
+
+            element.left = element.left > size ? 0 : element.left;
+            element.right = element.right > size ? 0 : element.right;
+        }
+    }
+
+    void emplace_back(uchar_t _byte, uint32_t _prev)
+    {
+        node.push_back({0, 0, 0, _byte, 0, generation});
+        prev.emplace_back(_prev);
+    }
+
+    void assign(size_t index, uchar_t _byte, uint32_t _prev)
+    {
+        node[index] = {0, 0, 0, _byte, 0, generation};
+        prev[index] = _prev;
+    }
+
+    uchar_t get_byte(size_t index) const { return node[index].byte; }
+    uint32_t get_prev(size_t index) const { return prev[index]; }
+    uint32_t get_left(size_t index) const { return node[index].left; }
+    uint32_t get_right(size_t index) const { return node[index].right; }
+
+    uint32_t get_next(size_t index) const
+    {
+        const Node &element = node[index];
+        return element.generation == generation ? element.next : 0;
+    }
+
+    void set_next(size_t index, uint32_t value)
+    {
+        node[index].next = value;
+        node[index].generation = generation;
+    }
+
+    void set_left(size_t index, uint32_t value) { node[index].left = value; }
+    void set_right(size_t index, uint32_t value) { node[index].right = value; }
+}; // struct PackedMemory
+
+// Encoder dictionary, MEMORY picks the layout of its elements (Memory or
+// PackedMemory). Numbering and reset points do not depend on the layout,
+// the size limit is always counted in Elements.
+template<typename MEMORY>
+class BasicDictionary
 {
 protected:
-    Memory memory;
+    MEMORY memory;
 
     size_t size_limit;
     uint32_t current;
 
+    // For Stats
+    uint64_t steps;
+    uint64_t probes;
+    Resets resets;
+
 public:
-    Dictionary(size_t _size_limit);
+    BasicDictionary(size_t _size_limit, bool _huge_pages=false);
     bool step(uchar_t byte, size_t &id);
     void step_back(uchar_t &byte, size_t &id);
     std::vector<uchar_t> jump(size_t id);
+    void select(size_t id);
     void add_suffix(uchar_t byte);
+    void recycle(size_t id, uchar_t byte);
     virtual void clear(void);
     size_t size(void) const;
     bool empty(void) const;
+    bool full(void) const; // next add_suffix would clear
+
+    uchar_t get_byte(size_t id) const;
+    size_t get_prev(size_t id) const;
+
+    void collect(Stats &stats) const;
 
 protected:
     bool is_valid(uint32_t id) const
@@ -114,30 +308,44 @@ protected:
         return 0 < id && id <= memory.size();
     }
 
-}; // class Dictionary
+    bool attach(uchar_t byte, uint32_t id);
+    void detach(uint32_t id);
+    void truncate(size_t size);
+}; // class BasicDictionary
+
+typedef BasicDictionary<Memory> Dictionary;
+typedef BasicDictionary<PackedMemory> PackedDictionary;
 
-template<int VALUES>
-class PrepopulatedDictionary: public Dictionary
+template<int VALUES, typename BASE=Dictionary>
+class PrepopulatedDictionary: public BASE
 {
 public:
-    PrepopulatedDictionary(size_t _size_limit);
+    template<typename... ARGS>
+    PrepopulatedDictionary(size_t _size_limit, ARGS... _args);
 
     void clear(void) override;
     bool empty(void) const;
 }; // class PrepopulatedDictionary
 
+// With huge_pages the arrays live in a single arena backed by transparent
+// huge pages, which cuts TLB misses on big dictionaries
+template<typename MEMORY>
 inline
-Dictionary::Dictionary(size_t _size_limit)
-:memory{}
+BasicDictionary<MEMORY>::BasicDictionary(size_t _size_limit, bool _huge_pages)
+:memory{_huge_pages ? std::make_shared<Arena>(MEMORY::footprint(_size_limit / sizeof(Element))) : nullptr}
 ,size_limit{_size_limit}
 ,current{0}
+,steps{0}
+,probes{0}
+,resets{}
 {
     memory.reserve(size_limit / sizeof(Element));
     assert(memory.capacity() >= size_limit / sizeof(Element));
 }
 
+template<typename MEMORY>
 inline
-bool Dictionary::step(uchar_t byte, size_t &id)
+bool BasicDictionary<MEMORY>::step(uchar_t byte, size_t &id)
 {
     if(memory.empty())
     {
@@ -147,11 +355,13 @@ bool Dictionary::step(uchar_t byte, size_t &id)
 
     size_t search = 1;
     if(is_valid(current))
-        search = memory.next[current - 1];
+        search = memory.get_next(current - 1);
 
+    ++ steps;
     while(is_valid(search))
     {
-        uchar_t &elbyte = memory.byte[search - 1];
+        ++ probes;
+        uchar_t elbyte = memory.get_byte(search - 1);
         if(elbyte == byte)
         {
             id = current = search;
@@ -159,25 +369,27 @@ bool Dictionary::step(uchar_t byte, size_t &id)
         }
 
         else if(elbyte < byte)
-            search = memory.right[search - 1];
+            search = memory.get_right(search - 1);
 
         else
-            search = memory.left[search - 1];
+            search = memory.get_left(search - 1);
     }
 
     return false;
 }
 
+template<typename MEMORY>
 inline
-void Dictionary::step_back(uchar_t &byte, size_t &id)
+void BasicDictionary<MEMORY>::step_back(uchar_t &byte, size_t &id)
 {
     assert(is_valid(current));
-    byte = memory.byte[current - 1];
-    id = current = memory.prev[current - 1];
+    byte = memory.get_byte(current - 1);
+    id = current = memory.get_prev(current - 1);
 }
 
+template<typename MEMORY>
 inline
-std::vector<uchar_t> Dictionary::jump(size_t id)
+std::vector<uchar_t> BasicDictionary<MEMORY>::jump(size_t id)
 {
     if(!id)
         return {};
@@ -186,8 +398,8 @@ std::vector<uchar_t> Dictionary::jump(size_t id)
     current = id;
     while(is_valid(current))
     {
-        result.push_back(memory.byte[current - 1]);
-        current = memory.prev[current - 1];
+        result.push_back(memory.get_byte(current - 1));
+        current = memory.get_prev(current - 1);
     }
 
     current = id;
@@ -195,10 +407,19 @@ std::vector<uchar_t> Dictionary::jump(size_t id)
     return result;
 }
 
+template<typename MEMORY>
 inline
-void Dictionary::add_suffix(uchar_t byte)
+void BasicDictionary<MEMORY>::select(size_t id)
 {
-    if((memory.size() + 1) * sizeof(Element) > size_limit)
+    assert(!id || is_valid(id));
+    current = id;
+}
+
+template<typename MEMORY>
+inline
+void BasicDictionary<MEMORY>::add_suffix(uchar_t byte)
+{
+    if(full())
     {
         clear();
         return;
@@ -211,16 +432,41 @@ void Dictionary::add_suffix(uchar_t byte)
         return;
     }
 
+    if(!attach(byte, memory.size() + 1))
+        return;
+
+    memory.emplace_back(byte, current);
+    current = 0;
+}
+
+// Turns leaf id (an element without suffixes) into suffix byte of the
+// current element. The suffix must not be present yet.
+template<typename MEMORY>
+inline
+void BasicDictionary<MEMORY>::recycle(size_t id, uchar_t byte)
+{
+    assert(is_valid(id) && is_valid(current) && id != current);
+    assert(!is_valid(memory.get_next(id - 1)));
+    detach(id);
+    memory.assign(id - 1, byte, current);
+    attach(byte, id);
+    current = 0;
+}
+
+// Links id as suffix byte of the current element, unless there already is
+// one
+template<typename MEMORY>
+inline
+bool BasicDictionary<MEMORY>::attach(uchar_t byte, uint32_t id)
+{
     uint32_t search = 1;
     if(is_valid(current))
     {
-        uint32_t &elnext = memory.next[current - 1];
+        uint32_t elnext = memory.get_next(current - 1);
         if(!is_valid(elnext))
         {
-            elnext = memory.size() + 1;
-            memory.emplace_back(byte, current);
-            current = 0;
-            return;
+            memory.set_next(current - 1, id);
+            return true;
         }
 
         search = elnext;
@@ -228,54 +474,154 @@ void Dictionary::add_suffix(uchar_t byte)
 
     while(is_valid(search))
     {
-        uchar_t elbyte = memory.byte[search - 1];
+        uchar_t elbyte = memory.get_byte(search - 1);
+        uint32_t parent = search;
         if(elbyte < byte)
         {
-            uint32_t &elright = memory.right[search - 1];
-            search = elright;
+            search = memory.get_right(parent - 1);
             if(!is_valid(search))
-                elright = memory.size() + 1;
+                memory.set_right(parent - 1, id);
         }
 
         else if(elbyte > byte)
         {
-            uint32_t &elleft = memory.left[search - 1];
-            search = elleft;
+            search = memory.get_left(parent - 1);
             if(!is_valid(search))
-                elleft = memory.size() + 1;
+                memory.set_left(parent - 1, id);
         }
 
         else // ==
-            return;
+            return false;
     }
 
-    memory.emplace_back(byte, current);
-    current = 0;
+    return true;
+}
+
+// Unlinks id from the tree of suffixes of its prefix, a node with both
+// subtrees is replaced by the smallest node of the right one
+template<typename MEMORY>
+inline
+void BasicDictionary<MEMORY>::detach(uint32_t id)
+{
+    uint32_t prefix = memory.get_prev(id - 1);
+    assert(is_valid(prefix) && "Suffixes of the empty string are fixed");
+
+    uchar_t byte = memory.get_byte(id - 1);
+    uint32_t parent = 0;
+    uint32_t search = memory.get_next(prefix - 1);
+    while(search != id)
+    {
+        assert(is_valid(search));
+        parent = search;
+        if(memory.get_byte(search - 1) < byte)
+            search = memory.get_right(search - 1);
+
+        else
+            search = memory.get_left(search - 1);
+    }
+
+    uint32_t left = memory.get_left(id - 1);
+    uint32_t right = memory.get_right(id - 1);
+    uint32_t replacement = is_valid(left) ? left : right;
+    if(is_valid(left) && is_valid(right))
+    {
+        uint32_t successor_parent = id;
+        replacement = right;
+        while(is_valid(memory.get_left(replacement - 1)))
+        {
+            successor_parent = replacement;
+            replacement = memory.get_left(replacement - 1);
+        }
+
+        if(successor_parent != id)
+        {
+            memory.set_left(successor_parent - 1, memory.get_right(replacement - 1));
+            memory.set_right(replacement - 1, right);
+        }
+
+        memory.set_left(replacement - 1, left);
+    }
+
+    if(!parent)
+        memory.set_next(prefix - 1, is_valid(replacement) ? replacement : 0);
+
+    else if(memory.get_byte(parent - 1) < byte)
+        memory.set_right(parent - 1, is_valid(replacement) ? replacement : 0);
+
+    else
+        memory.set_left(parent - 1, is_valid(replacement) ? replacement : 0);
 }
 
+template<typename MEMORY>
 inline
-void Dictionary::clear(void)
+void BasicDictionary<MEMORY>::clear(void)
 {
+    resets.add(size());
     current = 0;
     memory.clear();
 }
 
+// Drops every element above size
+template<typename MEMORY>
+inline
+void BasicDictionary<MEMORY>::truncate(size_t size)
+{
+    resets.add(this->size());
+    current = 0;
+    memory.truncate(size);
+}
+
+template<typename MEMORY>
 inline
-size_t Dictionary::size(void) const
+size_t BasicDictionary<MEMORY>::size(void) const
 {
     return memory.size();
 }
 
+template<typename MEMORY>
 inline
-bool Dictionary::empty(void) const
+bool BasicDictionary<MEMORY>::empty(void) const
 {
     return !size();
 }
 
-template<int VALUES>
+template<typename MEMORY>
 inline
-PrepopulatedDictionary<VALUES>::PrepopulatedDictionary(size_t _size_limit)
-:Dictionary{_size_limit}
+bool BasicDictionary<MEMORY>::full(void) const
+{
+    return (size() + 1) * sizeof(Element) > size_limit;
+}
+
+template<typename MEMORY>
+inline
+uchar_t BasicDictionary<MEMORY>::get_byte(size_t id) const
+{
+    assert(is_valid(id));
+    return memory.get_byte(id - 1);
+}
+
+template<typename MEMORY>
+inline
+size_t BasicDictionary<MEMORY>::get_prev(size_t id) const
+{
+    assert(is_valid(id));
+    return memory.get_prev(id - 1);
+}
+
+template<typename MEMORY>
+inline
+void BasicDictionary<MEMORY>::collect(Stats &stats) const
+{
+    stats.steps += steps;
+    stats.probes += probes;
+    stats.resets.merge(resets);
+}
+
+template<int VALUES, typename BASE>
+template<typename... ARGS>
+inline
+PrepopulatedDictionary<VALUES, BASE>::PrepopulatedDictionary(size_t _size_limit, ARGS... _args)
+:BASE{_size_limit, _args...}
 {
     for(size_t value = VALUES / 2; value > 0; value /= 2)
         for(size_t current =  value; current < VALUES; current += value * 2)
@@ -285,20 +631,18 @@ PrepopulatedDictionary<VALUES>::PrepopulatedDictionary(size_t _size_limit)
     assert(this->size() == 256);
 }
 
-template<int VALUES>
+template<int VALUES, typename BASE>
 inline
-void PrepopulatedDictionary<VALUES>::clear(void)
+void PrepopulatedDictionary<VALUES, BASE>::clear(void)
 {
-    current = 0;
-    memory.resize(VALUES);
-    bzero(&memory.next[0], sizeof(uint32_t) * VALUES);
+    this->truncate(VALUES);
 }
 
-template<int VALUES>
+template<int VALUES, typename BASE>
 inline
-bool PrepopulatedDictionary<VALUES>::empty(void) const
+bool PrepopulatedDictionary<VALUES, BASE>::empty(void) const
 {
-    return size() == VALUES;
+    return this->size() == VALUES;
 }
 
 #endif // __DICTIONARY_H__
@@ -0,0 +1,44 @@
+#ifndef __ENTROPY_H__
+#define __ENTROPY_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+typedef unsigned char uchar_t;
+
+// Order-0 (byte frequency) entropy of data in bits per byte. Cheap enough to
+// run over every block: one pass of counting and 256 logarithms. Counting
+// goes into four tables so consecutive equal bytes do not wait on each other.
+inline
+double order0_entropy(const uchar_t *data, size_t size)
+{
+    if(!size)
+        return 0;
+
+    uint32_t count[4][256];
+    memset(count, 0, sizeof(count));
+    size_t b = 0;
+    for(; b + 4 <= size; b += 4)
+    {
+        ++ count[0][data[b]];
+        ++ count[1][data[b + 1]];
+        ++ count[2][data[b + 2]];
+        ++ count[3][data[b + 3]];
+    }
+
+    for(; b < size; ++ b)
+        ++ count[0][data[b]];
+
+    double entropy = 0;
+    for(size_t value = 0; value < 256; ++ value)
+    {
+        uint64_t total = (uint64_t) count[0][value] + count[1][value] + count[2][value] + count[3][value];
+        if(total)
+            entropy -= total * std::log2((double) total / size);
+    }
+
+    return entropy / size;
+}
+
+#endif // __ENTROPY_H__
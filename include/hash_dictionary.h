@@ -0,0 +1,286 @@
+#ifndef __HASH_DICTIONARY_H__
+#define __HASH_DICTIONARY_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dictionary.h"
+
+// Dictionary with the same numbering and reset points as Dictionary, but
+// (prefix, byte) -> suffix lookups go through a single open addressing table
+// instead of walking the per-prefix binary tree.
+//
+// Every slot packs the whole entry into one word:
+//      bits  0-7   byte
+//      bits  8-34  prefix id
+//      bits 35-63  element id (0 means empty slot)
+class HashDictionary
+{
+protected:
+    static const size_t     KEY_BITS = 35;
+    static const uint64_t   KEY_MASK = ((uint64_t) 1 << KEY_BITS) - 1;
+
+    std::vector<uchar_t>    byte;
+    std::vector<uint32_t>   prev; // prefix
+    std::vector<uint64_t>   table;
+    size_t                  table_shift;
+
+    size_t size_limit;
+    uint32_t current;
+
+public:
+    HashDictionary(size_t _size_limit);
+    bool step(uchar_t byte, size_t &id);
+    void step_back(uchar_t &byte, size_t &id);
+    std::vector<uchar_t> jump(size_t id);
+    void select(size_t id);
+    void add_suffix(uchar_t byte);
+    void recycle(size_t id, uchar_t byte);
+    virtual void clear(void);
+    size_t size(void) const;
+    bool empty(void) const;
+    bool full(void) const; // next add_suffix would clear
+
+    uchar_t get_byte(size_t id) const;
+    size_t get_prev(size_t id) const;
+
+protected:
+    bool is_valid(uint32_t id) const
+    {
+        return 0 < id && id <= byte.size();
+    }
+
+    static uint64_t make_key(uint32_t prefix, uchar_t byte)
+    {
+        return ((uint64_t) prefix << 8) | byte;
+    }
+
+    size_t slot(uint64_t key) const
+    {
+        return (key * 0x9E3779B97F4A7C15ULL) >> table_shift;
+    }
+
+    uint32_t find(uint64_t key, size_t &position) const;
+    void insert(uint64_t key, uint32_t id, size_t position);
+    void erase(size_t position);
+    void truncate(size_t size);
+}; // class HashDictionary
+
+inline
+HashDictionary::HashDictionary(size_t _size_limit)
+:byte{}
+,prev{}
+,table{}
+,table_shift{64}
+,size_limit{_size_limit}
+,current{0}
+{
+    const size_t elements = size_limit / sizeof(Element);
+    assert(elements < ((size_t) 1 << (64 - KEY_BITS)) && "Dictionary too big");
+    byte.reserve(elements);
+    prev.reserve(elements);
+
+    // Keep load factor below 2/3
+    size_t slots = 1;
+    while(slots < elements + elements / 2 + 1)
+    {
+        slots *= 2;
+        -- table_shift;
+    }
+
+    table.resize(slots);
+}
+
+inline
+uint32_t HashDictionary::find(uint64_t key, size_t &position) const
+{
+    const size_t mask = table.size() - 1;
+    position = slot(key);
+    while(table[position])
+    {
+        if((table[position] & KEY_MASK) == key)
+            return table[position] >> KEY_BITS;
+
+        position = (position + 1) & mask;
+    }
+
+    return 0;
+}
+
+inline
+void HashDictionary::insert(uint64_t key, uint32_t id, size_t position)
+{
+    assert(!table[position]);
+    table[position] = ((uint64_t) id << KEY_BITS) | key;
+}
+
+// Linear probing has no tombstones, entries further along the probe
+// sequence are shifted back into the hole instead
+inline
+void HashDictionary::erase(size_t position)
+{
+    const size_t mask = table.size() - 1;
+    for(size_t next = (position + 1) & mask; table[next]; next = (next + 1) & mask)
+    {
+        size_t home = slot(table[next] & KEY_MASK);
+        if(((next - home) & mask) >= ((next - position) & mask))
+        {
+            table[position] = table[next];
+            position = next;
+        }
+    }
+
+    table[position] = 0;
+}
+
+inline
+bool HashDictionary::step(uchar_t _byte, size_t &id)
+{
+    if(byte.empty())
+    {
+        id = 0;
+        return false;
+    }
+
+    size_t position;
+    uint32_t found = find(make_key(is_valid(current) ? current : 0, _byte), position);
+    if(!found)
+        return false;
+
+    id = current = found;
+    return true;
+}
+
+inline
+void HashDictionary::step_back(uchar_t &_byte, size_t &id)
+{
+    assert(is_valid(current));
+    _byte = byte[current - 1];
+    id = current = prev[current - 1];
+}
+
+inline
+std::vector<uchar_t> HashDictionary::jump(size_t id)
+{
+    if(!id)
+        return {};
+
+    std::vector<uchar_t> result;
+    current = id;
+    while(is_valid(current))
+    {
+        result.push_back(byte[current - 1]);
+        current = prev[current - 1];
+    }
+
+    current = id;
+    std::reverse(begin(result), end(result));
+    return result;
+}
+
+inline
+void HashDictionary::select(size_t id)
+{
+    assert(!id || is_valid(id));
+    current = id;
+}
+
+inline
+void HashDictionary::add_suffix(uchar_t _byte)
+{
+    if(full())
+    {
+        clear();
+        return;
+    }
+
+    uint32_t prefix = is_valid(current) ? current : 0;
+    uint64_t key = make_key(prefix, _byte);
+    size_t position;
+    if(find(key, position))
+        return;
+
+    byte.emplace_back(_byte);
+    prev.emplace_back(prefix);
+    insert(key, byte.size(), position);
+    current = 0;
+}
+
+// Turns element id, which nothing uses as prefix, into suffix byte of the
+// current element. The suffix must not be present yet.
+inline
+void HashDictionary::recycle(size_t id, uchar_t _byte)
+{
+    assert(is_valid(id) && is_valid(current) && id != current);
+    size_t position;
+    find(make_key(prev[id - 1], byte[id - 1]), position);
+    assert(table[position] >> KEY_BITS == id);
+    erase(position);
+
+    uint64_t key = make_key(current, _byte);
+    find(key, position);
+    insert(key, id, position);
+    byte[id - 1] = _byte;
+    prev[id - 1] = current;
+    current = 0;
+}
+
+inline
+void HashDictionary::clear(void)
+{
+    truncate(0);
+}
+
+// Drops every element above size and rebuilds the table from the rest.
+inline
+void HashDictionary::truncate(size_t size)
+{
+    current = 0;
+    byte.resize(size);
+    prev.resize(size);
+    std::fill(begin(table), end(table), 0);
+    for(size_t id = 1; id <= size; ++ id)
+    {
+        uint64_t key = make_key(prev[id - 1], byte[id - 1]);
+        size_t position;
+        find(key, position);
+        insert(key, id, position);
+    }
+}
+
+inline
+size_t HashDictionary::size(void) const
+{
+    return byte.size();
+}
+
+inline
+bool HashDictionary::empty(void) const
+{
+    return !size();
+}
+
+inline
+bool HashDictionary::full(void) const
+{
+    return (size() + 1) * sizeof(Element) > size_limit;
+}
+
+inline
+uchar_t HashDictionary::get_byte(size_t id) const
+{
+    assert(is_valid(id));
+    return byte[id - 1];
+}
+
+inline
+size_t HashDictionary::get_prev(size_t id) const
+{
+    assert(is_valid(id));
+    return prev[id - 1];
+}
+
+#endif // __HASH_DICTIONARY_H__
@@ -0,0 +1,367 @@
+#ifndef __HEADER_H__
+#define __HEADER_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+typedef unsigned char uchar_t;
+
+// Compressed stream header:
+//      offset  size    field
+//      0       4       magic "LZKD"
+//      4       1       format version (2)
+//      5       1       entropy coder (Coder)
+//      6       1       algorithm (Algorithm)
+//      7       1       dictionary bits
+//      8       4       entropy coder block size (0 if coder has no blocks)
+//      12      1       flags (Header::FLAG_*)
+//      13      4       preset dictionary id, only with FLAG_PRESET
+//
+// With FLAG_FRAMED the data is a sequence of independently compressed
+// frames, each starting with:
+//      0       4       bits 0-29: size of the frame data (0 ends the
+//                      sequence), bits 30-31: Frame::Type
+//      4       4       uncompressed size of the frame
+//
+// Version 2 streams end with a trailer:
+//      0       8       uncompressed length
+//      8       4       Adler-32 of uncompressed data
+//
+// All numbers are little endian. Streams without the magic come from
+// versions before the header existed, they are always FGK coded. Version 1
+// header had only the magic, version and entropy coder fields, and no
+// trailer.
+enum Coder: uint8_t
+{
+    FGK,
+    VITTER,
+    CANONICAL,
+    CODERS
+}; // enum Coder
+
+enum Algorithm: uint8_t
+{
+    ALGORITHM_LZ78,
+    ALGORITHM_LZW,
+    ALGORITHMS
+}; // enum Algorithm
+
+const char HEADER_MAGIC[4] = {'L', 'Z', 'K', 'D'};
+
+struct Header
+{
+    static const uint8_t    VERSION = 2;
+    static const uint8_t    FLAG_FRAMED = 1;
+    static const uint8_t    FLAG_ADAPTIVE_RESET = 2;
+    static const uint8_t    FLAG_RECYCLE = 4; // takes precedence over FLAG_ADAPTIVE_RESET
+    static const uint8_t    FLAG_PRESET = 8;
+    static const uint8_t    KNOWN_FLAGS = FLAG_FRAMED | FLAG_ADAPTIVE_RESET | FLAG_RECYCLE | FLAG_PRESET;
+
+    uint8_t     version;
+    Coder       coder;
+    Algorithm   algorithm;
+    uint8_t     bit_size;
+    uint32_t    block_size;
+    uint8_t     flags;
+    uint32_t    preset;
+
+    Header(Algorithm _algorithm=ALGORITHM_LZW, uint8_t _bit_size=0, Coder _coder=FGK, uint32_t _block_size=0);
+
+    bool legacy(void) const;
+    bool has_trailer(void) const;
+
+    void write(std::ostream &stream) const;
+    bool read(std::istream &stream);
+}; // struct Header
+
+struct Trailer
+{
+    static const size_t     SIZE = 12;
+
+    uint64_t    length;
+    uint32_t    checksum;
+
+    Trailer(uint64_t _length=0, uint32_t _checksum=0);
+
+    void write(std::ostream &stream) const;
+    void read(const uchar_t *buffer);
+}; // struct Trailer
+
+struct Frame
+{
+    static const size_t     SIZE = 8;
+    static const size_t     TYPE_SHIFT = 30;
+    static const uint32_t   MAX_SIZE = (1U << TYPE_SHIFT) - 1;
+
+    enum Type: uint8_t
+    {
+        CODED,      // LZ codes through the entropy coder from the header
+        UNCODED,    // LZ codes as they are
+        STORED,     // input as it is
+    }; // enum Type
+
+    uint32_t    size;
+    uint32_t    length;
+    Type        type;
+
+    Frame(uint32_t _size=0, uint32_t _length=0, Type _type=CODED);
+
+    void write(std::ostream &stream) const;
+    bool read(std::istream &stream);
+}; // struct Frame
+
+// Stream buffer reading another stream buffer except for its last
+// Trailer::SIZE bytes, which are kept aside as the trailer. Decoders reading
+// ahead therefore never swallow the trailer.
+class TrailerBuffer: public std::streambuf
+{
+    std::streambuf      *source;
+    std::vector<char>   buffer;
+    size_t              fill;
+    bool                eof;
+
+public:
+    TrailerBuffer(std::streambuf *_source, size_t _buffer_size=1U << 16);
+
+    bool trailer(Trailer &trailer);
+
+protected:
+    int_type underflow(void) override;
+}; // class TrailerBuffer
+
+const char *const CODER_NAME[CODERS] =
+{
+    "fgk",
+    "vitter",
+    "canonical",
+};
+
+const char *const ALGORITHM_NAME[ALGORITHMS] =
+{
+    "lz78",
+    "lzw",
+};
+
+inline
+void put_le(uchar_t *buffer, uint64_t value, size_t bytes)
+{
+    for(size_t b = 0; b < bytes; ++ b)
+        buffer[b] = value >> (8 * b);
+}
+
+inline
+uint64_t get_le(const uchar_t *buffer, size_t bytes)
+{
+    uint64_t value = 0;
+    for(size_t b = bytes; b --; )
+        value = value << 8 | buffer[b];
+
+    return value;
+}
+
+inline
+Header::Header(Algorithm _algorithm, uint8_t _bit_size, Coder _coder, uint32_t _block_size)
+:version{VERSION}
+,coder{_coder}
+,algorithm{_algorithm}
+,bit_size{_bit_size}
+,block_size{_block_size}
+,flags{0}
+,preset{0}
+{
+}
+
+inline
+bool Header::legacy(void) const
+{
+    return !version;
+}
+
+inline
+bool Header::has_trailer(void) const
+{
+    return version >= 2;
+}
+
+inline
+void Header::write(std::ostream &stream) const
+{
+    uchar_t fields[9];
+    fields[0] = version;
+    fields[1] = coder;
+    fields[2] = algorithm;
+    fields[3] = bit_size;
+    put_le(fields + 4, block_size, 4);
+    fields[8] = flags;
+
+    stream.write(HEADER_MAGIC, sizeof(HEADER_MAGIC));
+    stream.write((char *) fields, sizeof(fields));
+    if(flags & FLAG_PRESET)
+    {
+        uchar_t id[4];
+        put_le(id, preset, 4);
+        stream.write((char *) id, sizeof(id));
+    }
+}
+
+// Reads header if there is one. Otherwise gives already read bytes back to
+// the stream and describes a legacy stream.
+inline
+bool Header::read(std::istream &stream)
+{
+    char magic[sizeof(HEADER_MAGIC)];
+    std::streambuf *buffer = stream.rdbuf();
+    std::streamsize count = buffer->sgetn(magic, sizeof(magic));
+    *this = Header{};
+    if(count != sizeof(HEADER_MAGIC) || memcmp(magic, HEADER_MAGIC, sizeof(HEADER_MAGIC)))
+    {
+        while(count --)
+            if(buffer->sungetc() == std::char_traits<char>::eof())
+                return false;
+
+        version = 0;
+        return true;
+    }
+
+    uchar_t fields[9];
+    if(buffer->sgetn((char *) fields, 2) != 2)
+        return false;
+
+    version = fields[0];
+    coder = (Coder) fields[1];
+    if(version == 1)
+        return coder < CODERS;
+
+    if(version != VERSION || buffer->sgetn((char *) fields + 2, 7) != 7)
+        return false;
+
+    algorithm = (Algorithm) fields[2];
+    bit_size = fields[3];
+    block_size = get_le(fields + 4, 4);
+    flags = fields[8];
+    if(flags & FLAG_PRESET)
+    {
+        uchar_t id[4];
+        if(buffer->sgetn((char *) id, sizeof(id)) != sizeof(id))
+            return false;
+
+        preset = get_le(id, 4);
+    }
+
+    return coder < CODERS && algorithm < ALGORITHMS && !(flags & ~KNOWN_FLAGS);
+}
+
+inline
+Trailer::Trailer(uint64_t _length, uint32_t _checksum)
+:length{_length}
+,checksum{_checksum}
+{
+}
+
+inline
+void Trailer::write(std::ostream &stream) const
+{
+    uchar_t buffer[SIZE];
+    put_le(buffer, length, 8);
+    put_le(buffer + 8, checksum, 4);
+    stream.write((char *) buffer, SIZE);
+}
+
+inline
+void Trailer::read(const uchar_t *buffer)
+{
+    length = get_le(buffer, 8);
+    checksum = get_le(buffer + 8, 4);
+}
+
+inline
+Frame::Frame(uint32_t _size, uint32_t _length, Type _type)
+:size{_size}
+,length{_length}
+,type{_type}
+{
+}
+
+inline
+void Frame::write(std::ostream &stream) const
+{
+    assert(size <= MAX_SIZE);
+    uchar_t buffer[SIZE];
+    put_le(buffer, (uint32_t) type << TYPE_SHIFT | size, 4);
+    put_le(buffer + 4, length, 4);
+    stream.write((char *) buffer, SIZE);
+}
+
+inline
+bool Frame::read(std::istream &stream)
+{
+    uchar_t buffer[SIZE];
+    if(!stream.read((char *) buffer, SIZE))
+        return false;
+
+    uint32_t field = get_le(buffer, 4);
+    size = field & MAX_SIZE;
+    type = (Type) (field >> TYPE_SHIFT);
+    length = get_le(buffer + 4, 4);
+    return type <= STORED && (type != STORED || size == length);
+}
+
+inline
+TrailerBuffer::TrailerBuffer(std::streambuf *_source, size_t _buffer_size)
+:source{_source}
+,buffer(_buffer_size + Trailer::SIZE)
+,fill{0}
+,eof{false}
+{
+}
+
+// Gives the trailer once the rest of the stream is read (and skipped), fails
+// if the stream was too short to have one.
+inline
+bool TrailerBuffer::trailer(Trailer &trailer)
+{
+    while(underflow() != traits_type::eof())
+        setg(egptr(), egptr(), egptr());
+
+    if(fill < Trailer::SIZE)
+        return false;
+
+    trailer.read((uchar_t *) buffer.data() + fill - Trailer::SIZE);
+    return true;
+}
+
+inline
+TrailerBuffer::int_type TrailerBuffer::underflow(void)
+{
+    if(gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    // Bytes held back last time are still candidates for the trailer
+    size_t held = fill < Trailer::SIZE ? fill : (size_t) Trailer::SIZE;
+    memmove(buffer.data(), buffer.data() + fill - held, held);
+    fill = held;
+    while(!eof && fill < buffer.size())
+    {
+        std::streamsize count = source->sgetn(buffer.data() + fill, buffer.size() - fill);
+        if(count <= 0)
+            eof = true;
+
+        else
+            fill += count;
+    }
+
+    if(fill <= Trailer::SIZE)
+    {
+        setg(buffer.data(), buffer.data() + fill, buffer.data() + fill);
+        return traits_type::eof();
+    }
+
+    setg(buffer.data(), buffer.data(), buffer.data() + fill - Trailer::SIZE);
+    return traits_type::to_int_type(*gptr());
+}
+
+#endif // __HEADER_H__
@@ -0,0 +1,215 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+typedef unsigned char uchar_t;
+
+// Decoder side output window.
+//
+// Every dictionary element remembers (offset, length) of the last place its
+// phrase was written to the output, so expanding a code is a single copy from
+// the window. Elements whose phrase already slid out of the window are
+// rebuilt backwards straight into the output from the dictionary prefix
+// chain - their length is known, so nothing has to be reversed.
+template<typename SINK>
+class History
+{
+    static const uint64_t   NOWHERE = ~(uint64_t) 0;
+
+    SINK                    &sink;
+    std::vector<uchar_t>    buffer;
+    size_t                  window;
+    uint64_t                base; // output position of buffer[0]
+    size_t                  fill;
+    size_t                  flushed;
+    bool                    discard;
+
+    std::vector<uint64_t>   offset;
+    std::vector<uint32_t>   length;
+
+public:
+    History(SINK &_sink, size_t _window=1U << 22);
+
+    void simulate(void);
+    void flush(void);
+    void reset(void);
+
+    uint64_t position(void) const;
+    uchar_t at(uint64_t position) const;
+    size_t size(size_t id) const;
+
+    template<typename DICTIONARY>
+    void index(const DICTIONARY &dictionary);
+    void record(size_t id, uint64_t position, size_t bytes);
+
+    template<typename DICTIONARY>
+    void copy(const DICTIONARY &dictionary, size_t id);
+    void put(uchar_t byte);
+
+private:
+    uchar_t *claim(size_t bytes);
+}; // class History
+
+template<typename SINK>
+inline
+History<SINK>::History(SINK &_sink, size_t _window)
+:sink(_sink)
+,buffer{}
+,window{_window}
+,base{0}
+,fill{0}
+,flushed{0}
+,discard{false}
+,offset{}
+,length{}
+{
+}
+
+template<typename SINK>
+inline
+void History<SINK>::simulate(void)
+{
+    discard = true;
+}
+
+template<typename SINK>
+inline
+void History<SINK>::flush(void)
+{
+    if(!discard && fill > flushed)
+        sink.write((char *) &buffer[flushed], fill - flushed);
+
+    flushed = fill;
+}
+
+// Starts a new output, the buffer keeps its size
+template<typename SINK>
+inline
+void History<SINK>::reset(void)
+{
+    base = 0;
+    fill = 0;
+    flushed = 0;
+    offset.clear();
+    length.clear();
+}
+
+template<typename SINK>
+inline
+uint64_t History<SINK>::position(void) const
+{
+    return base + fill;
+}
+
+template<typename SINK>
+inline
+uchar_t History<SINK>::at(uint64_t _position) const
+{
+    assert(base <= _position && _position < position());
+    return buffer[_position - base];
+}
+
+template<typename SINK>
+inline
+size_t History<SINK>::size(size_t id) const
+{
+    return id ? length[id - 1] : 0;
+}
+
+// Records elements already present in the dictionary (e.g. prepopulated
+// alphabet) as not written anywhere yet.
+template<typename SINK>
+template<typename DICTIONARY>
+inline
+void History<SINK>::index(const DICTIONARY &dictionary)
+{
+    for(size_t id = 1; id <= dictionary.size(); ++ id)
+    {
+        size_t bytes = 0;
+        for(size_t current = id; current; current = dictionary.get_prev(current))
+            ++ bytes;
+
+        record(id, NOWHERE, bytes);
+    }
+}
+
+template<typename SINK>
+inline
+void History<SINK>::record(size_t id, uint64_t _position, size_t bytes)
+{
+    assert(id);
+    if(length.size() < id)
+    {
+        offset.resize(id);
+        length.resize(id);
+    }
+
+    offset[id - 1] = _position;
+    length[id - 1] = bytes;
+}
+
+template<typename SINK>
+template<typename DICTIONARY>
+inline
+void History<SINK>::copy(const DICTIONARY &dictionary, size_t id)
+{
+    assert(id && id <= length.size());
+    const uint64_t target = position();
+    const uint64_t source = offset[id - 1];
+    const size_t bytes = length[id - 1];
+    uchar_t *destination = claim(bytes);
+    if(base <= source && source < target)
+    {
+        assert(target - source >= bytes);
+        memcpy(destination, &buffer[source - base], bytes);
+    }
+
+    else
+    {
+        uchar_t *end = destination + bytes;
+        for(size_t current = id; current; current = dictionary.get_prev(current))
+            *-- end = dictionary.get_byte(current);
+
+        assert(end == destination);
+    }
+
+    offset[id - 1] = target;
+    fill += bytes;
+}
+
+template<typename SINK>
+inline
+void History<SINK>::put(uchar_t byte)
+{
+    *claim(1) = byte;
+    ++ fill;
+}
+
+// Makes room for bytes at the end of the buffer, keeping at least the last
+// window bytes of output available for copies.
+template<typename SINK>
+inline
+uchar_t *History<SINK>::claim(size_t bytes)
+{
+    if(fill + bytes > buffer.size())
+    {
+        flush();
+        size_t keep = std::min(fill, window);
+        if(keep)
+            memmove(buffer.data(), buffer.data() + fill - keep, keep);
+
+        base += fill - keep;
+        fill = flushed = keep;
+        if(fill + bytes > buffer.size())
+            buffer.resize(std::max(window * 2, fill + bytes));
+    }
+
+    return &buffer[fill];
+}
+
+#endif // __HISTORY_H__
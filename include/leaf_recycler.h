@@ -0,0 +1,179 @@
+#ifndef __LEAF_RECYCLER_H__
+#define __LEAF_RECYCLER_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "dictionary.h"
+
+// Least recently used order of dictionary leaves - elements that are not a
+// prefix of any other element, so their ids can be given to new phrases
+// without breaking any chain. Encoder and decoder keep identical copies:
+// it only depends on added elements and used codes, both seen by each side.
+//
+// Leaves form a doubly linked list from the oldest to the newest. An element
+// that loses its last suffix becomes a leaf again as the oldest one, nothing
+// used it directly for a while or its suffix would not have been recycled.
+// The first pinned elements (prepopulated alphabet) are never recycled.
+class LeafRecycler
+{
+public:
+    // Memory kept for every dictionary element
+    static const size_t ELEMENT_BYTES = 3 * sizeof(uint32_t);
+
+private:
+    std::vector<uint32_t>   older;
+    std::vector<uint32_t>   newer;
+    std::vector<uint32_t>   suffixes;
+    size_t                  pinned;
+    uint32_t                oldest;
+    uint32_t                newest;
+
+public:
+    LeafRecycler(size_t _pinned=0);
+
+    static size_t dictionary_limit(size_t size_limit);
+
+    void reset(void);
+    void add(size_t id, size_t prefix);
+    void remove(size_t id, size_t prefix);
+    void touch(size_t id);
+    size_t victim(size_t prefix) const;
+
+private:
+    bool is_leaf(size_t id) const
+    {
+        return id > pinned && !suffixes[id];
+    }
+
+    void push_newest(uint32_t id);
+    void push_oldest(uint32_t id);
+    void unlink(uint32_t id);
+}; // class LeafRecycler
+
+inline
+LeafRecycler::LeafRecycler(size_t _pinned)
+:older(_pinned + 1)
+,newer(_pinned + 1)
+,suffixes(_pinned + 1)
+,pinned{_pinned}
+,oldest{0}
+,newest{0}
+{
+}
+
+// Size limit for a dictionary (counted in Elements, like everywhere) that
+// leaves room for the recycler within size_limit bytes
+inline
+size_t LeafRecycler::dictionary_limit(size_t size_limit)
+{
+    return size_limit / (sizeof(Element) + ELEMENT_BYTES) * sizeof(Element);
+}
+
+// Forgets every leaf, memory is kept
+inline
+void LeafRecycler::reset(void)
+{
+    older.resize(pinned + 1);
+    newer.resize(pinned + 1);
+    suffixes.resize(pinned + 1);
+    std::fill(begin(suffixes), end(suffixes), 0);
+    oldest = 0;
+    newest = 0;
+}
+
+// New element id, suffix of prefix, is the most recently used leaf
+inline
+void LeafRecycler::add(size_t id, size_t prefix)
+{
+    assert(id > pinned && id != prefix);
+    if(suffixes.size() <= id)
+    {
+        older.resize(id + 1);
+        newer.resize(id + 1);
+        suffixes.resize(id + 1);
+    }
+
+    if(is_leaf(prefix))
+        unlink(prefix);
+
+    ++ suffixes[prefix];
+    suffixes[id] = 0;
+    push_newest(id);
+}
+
+// Leaf id, suffix of prefix, is about to get a new phrase
+inline
+void LeafRecycler::remove(size_t id, size_t prefix)
+{
+    assert(is_leaf(id) && suffixes[prefix]);
+    unlink(id);
+    if(!-- suffixes[prefix] && prefix > pinned)
+        push_oldest(prefix);
+}
+
+inline
+void LeafRecycler::touch(size_t id)
+{
+    if(!is_leaf(id) || id == newest)
+        return;
+
+    unlink(id);
+    push_newest(id);
+}
+
+// Least recently used leaf other than prefix of the element being added,
+// 0 when there is none
+inline
+size_t LeafRecycler::victim(size_t prefix) const
+{
+    return oldest != prefix ? oldest : newer[oldest];
+}
+
+inline
+void LeafRecycler::push_newest(uint32_t id)
+{
+    older[id] = newest;
+    newer[id] = 0;
+    if(newest)
+        newer[newest] = id;
+
+    else
+        oldest = id;
+
+    newest = id;
+}
+
+inline
+void LeafRecycler::push_oldest(uint32_t id)
+{
+    older[id] = 0;
+    newer[id] = oldest;
+    if(oldest)
+        older[oldest] = id;
+
+    else
+        newest = id;
+
+    oldest = id;
+}
+
+inline
+void LeafRecycler::unlink(uint32_t id)
+{
+    if(older[id])
+        newer[older[id]] = newer[id];
+
+    else
+        oldest = newer[id];
+
+    if(newer[id])
+        older[newer[id]] = older[id];
+
+    else
+        newest = older[id];
+}
+
+#endif // __LEAF_RECYCLER_H__
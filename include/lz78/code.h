@@ -1,8 +1,9 @@
-#ifndef __CODE_H__
-#define __CODE_H__
+#ifndef __LZ78_CODE_H__
+#define __LZ78_CODE_H__
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
@@ -28,6 +29,7 @@ public:
     size_t get_id(void) const;
     uchar_t get_byte(void) const;
     size_t bitsize(uint32_t maxbits) const;
+    uint64_t value(void) const;
 
     template<int SBITS>
     operator LZ78Code<SBITS>&(void);
@@ -85,6 +87,16 @@ size_t LZ78Code<BITS>::bitsize(uint32_t maxbits) const
     return 9 + (is_long_code() ? maxbits : 0);
 }
 
+// Code bits as they are written to the stream, lowest first
+template<int BITS>
+inline
+uint64_t LZ78Code<BITS>::value(void) const
+{
+    uint64_t value = 0;
+    memcpy(&value, this, sizeof(*this));
+    return value;
+}
+
 template<int BITS>
 template<int SBITS>
 inline
@@ -118,4 +130,4 @@ std::ostream &operator<<(std::ostream &stream, LZ78Code<BITS> &code)
                     << ", bitsize=" << code.bitsize(BITS) << ")";
 }
 
-#endif // __CODE_H__
+#endif // __LZ78_CODE_H__
@@ -3,7 +3,10 @@
 
 #include "bitstream.h"
 #include "code.h"
+#include "history.h"
+#include "stats.h"
 
+#include <utility>
 #include <vector>
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
@@ -12,11 +15,17 @@ class LZ78
     LOG         log;
     DICTIONARY  dictionary;
     OUTPUT      output;
+    History<OUTPUT> history;
 
     size_t      current_id{0};
     bool        simulation{false};
+    bool        finished{false};
     bool        error{false};
 
+    // For Stats
+    uint64_t    codes{0};
+    uint64_t    bytes{0};
+
 public:
     LZ78(LOG _log, DICTIONARY _dictionary, OUTPUT _output);
     ~LZ78(void);
@@ -24,6 +33,7 @@ public:
     void flush(void);
 
     void simulate(void);
+    void reset(void);
     bool good(void);
 
     template<typename INPUT>
@@ -32,6 +42,8 @@ public:
     template<typename INPUT>
     auto &decompress(INPUT input);
 
+    void collect(Stats &stats) const;
+
 private:
     auto &compress_bytes(uchar_t *byte, size_t size);
     auto &compress_byte(uchar_t byte);
@@ -46,8 +58,9 @@ template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 LZ78<LOG, DICTIONARY, OUTPUT>::LZ78(LOG _log, DICTIONARY _dictionary, OUTPUT _output)
 :log{_log}
-,dictionary{_dictionary}
+,dictionary{std::move(_dictionary)}
 ,output{_output}
+,history{output}
 {
 }
 
@@ -69,9 +82,13 @@ void LZ78<LOG, DICTIONARY, OUTPUT>::flush(void)
     {
         uchar_t last;
         dictionary.step_back(last, current_id);
-        log(log.DEBUG) << "Flushing last code";
+        if(log.enabled(log.DEBUG))
+            log(log.DEBUG) << "Flushing last code";
+
         write_current_code(last);
     }
+
+    history.flush();
 }
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
@@ -79,6 +96,19 @@ inline
 void LZ78<LOG, DICTIONARY, OUTPUT>::simulate(void)
 {
     simulation = true;
+    history.simulate();
+}
+
+// Ready for a new stream, dictionary and history keep their memory
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZ78<LOG, DICTIONARY, OUTPUT>::reset(void)
+{
+    dictionary.clear();
+    history.reset();
+    current_id = 0;
+    finished = false;
+    error = false;
 }
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
@@ -107,6 +137,7 @@ template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 auto &LZ78<LOG, DICTIONARY, OUTPUT>::compress_bytes(uchar_t *byte, size_t size)
 {
+    bytes += size;
     while(good() && size --)
         compress_byte(*byte ++);
 
@@ -145,38 +176,73 @@ template<typename INPUT>
 inline
 auto &LZ78<LOG, DICTIONARY, OUTPUT>::decompress(INPUT input)
 {
-    while(good() && input.good())
+    uint64_t start = history.position();
+    history.index(dictionary);
+    while(good() && !finished && input.good())
     {
+        // The kind bit tells the length, the whole code is then taken at
+        // once, so a code cut short is not mistaken for the padding after the
+        // last one
+        size_t id_bits = nearest2pow(dictionary.size() + 1);
+        uint64_t value = input.peek(9 + id_bits);
+        size_t bits = value & 1 ? 9 + id_bits : 9;
+        input.consume(bits);
+        value &= ((uint64_t) 1 << bits) - 1;
         LZ78Code<31> code;
-        input.read_bits((uchar_t *) &code, 8);
-        input.read_bits(((uchar_t *) &code) + 1, code.bitsize(nearest2pow(dictionary.size() + 1)) - 8);
+        memcpy((void *) &code, &value, sizeof(code));
         if(input.good())
             decompress_code(code);
     }
 
+    history.flush();
+    bytes += history.position() - start;
     return *this;
 }
 
+// The last code is only written by flush()
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZ78<LOG, DICTIONARY, OUTPUT>::collect(Stats &stats) const
+{
+    stats.codes += codes + !!current_id;
+    stats.phrase_bytes += bytes;
+    ::collect(stats, dictionary);
+    ::collect(stats, output);
+}
+
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
 template<int BITS>
 inline
 auto &LZ78<LOG, DICTIONARY, OUTPUT>::decompress_code(const LZ78Code<BITS> &code)
 {
-    log(log.DEBUG) << "Decompressing " << code << " realsize=" << code.bitsize(nearest2pow(dictionary.size() + 1));
-    if(code.get_id())
-    {
-        std::vector<uchar_t> data = dictionary.jump(code.get_id());
-        if(!simulation)
-            output.write((char *) &data[0], data.size() * sizeof(uchar_t));
-    }
+    ++ codes;
+    if(log.enabled(log.DEBUG))
+        log(log.DEBUG) << "Decompressing " << code << " realsize=" << code.bitsize(nearest2pow(dictionary.size() + 1));
 
-    if(!simulation)
+    if(code.get_id() > dictionary.size())
     {
-        char byte = code.get_byte();
-        output.write(&byte, 1);
+        // Padding of the last byte can decode into one more code, nothing
+        // valid can follow it
+        if(log.enabled(log.DEBUG))
+            log(log.DEBUG) << "Invalid code, end of data";
+
+        finished = true;
+        return *this;
     }
 
+    uint64_t offset = history.position();
+    if(code.get_id())
+        history.copy(dictionary, code.get_id());
+
+    history.put(code.get_byte());
+
+    size_t length = history.size(code.get_id()) + 1;
+    size_t size = dictionary.size();
+    dictionary.select(code.get_id());
     dictionary.add_suffix(code.get_byte());
+    if(dictionary.size() > size)
+        history.record(dictionary.size(), offset, length);
+
     return *this;
 }
 
@@ -185,10 +251,13 @@ inline
 void LZ78<LOG, DICTIONARY, OUTPUT>::write_current_code(uchar_t byte)
 {
     LZ78Code<31> code{byte, current_id};
-    log(log.DEBUG) << "Part compressed into " << code << " realsize=" << code.bitsize(nearest2pow(dictionary.size() + 1));
+    if(log.enabled(log.DEBUG))
+        log(log.DEBUG) << "Part compressed into " << code << " realsize=" << code.bitsize(nearest2pow(dictionary.size() + 1));
+
     if(!simulation)
-        output.write_bits((uchar_t*) &code, code.bitsize(nearest2pow(dictionary.size() + 1)));
+        output.append(code.value(), code.bitsize(nearest2pow(dictionary.size() + 1)));
 
+    ++ codes;
     current_id = 0;
 }
 
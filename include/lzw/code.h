@@ -1,8 +1,9 @@
-#ifndef __CODE_H__
-#define __CODE_H__
+#ifndef __LZW_CODE_H__
+#define __LZW_CODE_H__
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
@@ -21,6 +22,7 @@ public:
 
     size_t get_id(void) const;
     size_t bitsize(void) const;
+    uint64_t value(void) const;
 
     template<int SBITS>
     operator LZWCode<SBITS>&(void);
@@ -55,6 +57,16 @@ size_t LZWCode<BITS>::bitsize(void) const
     return BITS;
 }
 
+// Code bits as they are written to the stream, lowest first
+template<int BITS>
+inline
+uint64_t LZWCode<BITS>::value(void) const
+{
+    uint64_t value = 0;
+    memcpy(&value, this, sizeof(*this));
+    return value;
+}
+
 template<int BITS>
 template<int SBITS>
 inline
@@ -83,4 +95,4 @@ std::ostream &operator<<(std::ostream &stream, LZWCode<BITS> &code)
                     << "bitsize=" << code.bitsize() << ")";
 }
 
-#endif // __CODE_H__
+#endif // __LZW_CODE_H__
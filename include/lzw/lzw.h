@@ -3,21 +3,55 @@
 
 #include "bitstream.h"
 #include "code.h"
+#include "history.h"
+#include "leaf_recycler.h"
+#include "stats.h"
 
+#include <cassert>
+#include <utility>
 #include <vector>
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
 class LZW
 {
+    // With adaptive resets a full dictionary is kept as it is (frozen) while
+    // it compresses well, instead of being cleared right away. The ratio of
+    // LZ code bits is checked every CHECK_WINDOW input bytes; the dictionary
+    // is cleared once it expands data, does worse than while it was being
+    // filled or falls RESET_DROP below its best. The encoder tells the
+    // decoder with a CLEAR code: the id right after the last element, which
+    // is never used while the dictionary is full.
+    static const size_t CHECK_WINDOW = 1U << 13;
+    static constexpr double RESET_DROP = 0.1;
+
+    // With leaf recycling a full dictionary is never cleared, each new
+    // phrase takes the id of the least recently used leaf instead. Both
+    // sides pick the same leaf, so no extra codes are needed.
     LOG         log;
     DICTIONARY  dictionary;
     OUTPUT      output;
+    History<OUTPUT> history;
+    LeafRecycler recycler;
 
     size_t      previous_id{0};
+    uint64_t    previous_offset{0};
     size_t      current_id{0};
+    size_t      code_bits{1};
+    uint64_t    window_bytes{0};
+    uint64_t    window_bits{0};
+    double      fill_ratio{0};
+    double      best_ratio{0};
+    bool        adaptive{false};
+    bool        frozen{false};
+    bool        recycling{false};
     bool        simulation{false};
+    bool        finished{false};
     bool        error{false};
 
+    // For Stats
+    uint64_t    codes{0};
+    uint64_t    bytes{0};
+
 public:
     LZW(LOG _log, DICTIONARY _dictionary, OUTPUT _output);
     ~LZW(void);
@@ -25,6 +59,9 @@ public:
     void flush(void);
 
     void simulate(void);
+    void adaptive_reset(void);
+    void recycle_leaves(void);
+    void reset(void);
     bool good(void);
 
     template<typename INPUT>
@@ -33,22 +70,31 @@ public:
     template<typename INPUT>
     auto &decompress(INPUT input);
 
+    void collect(Stats &stats) const;
+
 private:
     auto &compress_bytes(uchar_t *byte, size_t size);
     auto &compress_byte(uchar_t byte);
 
+    template<int BITS, typename INPUT>
+    auto &decompress_codes(INPUT &input);
+
     template<int BITS>
     auto &decompress_code(const LZWCode<BITS> &code);
 
     void write_current_code(void);
+    void check_ratio(void);
+    size_t add_leaf(size_t prefix, uchar_t byte);
 }; // class LZW
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 LZW<LOG, DICTIONARY, OUTPUT>::LZW(LOG _log, DICTIONARY _dictionary, OUTPUT _output)
 :log{_log}
-,dictionary{_dictionary}
+,dictionary{std::move(_dictionary)}
 ,output{_output}
+,history{output}
+,recycler{}
 {
 }
 
@@ -68,9 +114,13 @@ void LZW<LOG, DICTIONARY, OUTPUT>::flush(void)
 
     if(current_id)
     {
-        log(log.DEBUG) << "Flushing last code";
+        if(log.enabled(log.DEBUG))
+            log(log.DEBUG) << "Flushing last code";
+
         write_current_code();
     }
+
+    history.flush();
 }
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
@@ -78,6 +128,48 @@ inline
 void LZW<LOG, DICTIONARY, OUTPUT>::simulate(void)
 {
     simulation = true;
+    history.simulate();
+}
+
+// Both sides have to agree on it, decoder's dictionary must hold as many
+// elements as encoder's
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZW<LOG, DICTIONARY, OUTPUT>::adaptive_reset(void)
+{
+    adaptive = true;
+}
+
+// Same agreement as for adaptive resets. Elements already present
+// (prepopulated alphabet) are never recycled.
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZW<LOG, DICTIONARY, OUTPUT>::recycle_leaves(void)
+{
+    recycling = true;
+    recycler = LeafRecycler{dictionary.size()};
+}
+
+// Ready for a new stream with the same settings, dictionary and history
+// keep their memory
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZW<LOG, DICTIONARY, OUTPUT>::reset(void)
+{
+    dictionary.clear();
+    history.reset();
+    recycler.reset();
+    previous_id = 0;
+    previous_offset = 0;
+    current_id = 0;
+    code_bits = 1;
+    window_bytes = 0;
+    window_bits = 0;
+    fill_ratio = 0;
+    best_ratio = 0;
+    frozen = false;
+    finished = false;
+    error = false;
 }
 
 template<typename LOG, typename DICTIONARY, typename OUTPUT>
@@ -106,6 +198,7 @@ template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 auto &LZW<LOG, DICTIONARY, OUTPUT>::compress_bytes(uchar_t *byte, size_t size)
 {
+    bytes += size;
     while(good() && size --)
         compress_byte(*byte ++);
 
@@ -116,10 +209,23 @@ template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 auto &LZW<LOG, DICTIONARY, OUTPUT>::compress_byte(uchar_t byte)
 {
+    ++ window_bytes;
     if(!dictionary.step(byte, current_id))
     {
+        size_t prefix = current_id;
         write_current_code();
-        dictionary.add_suffix(byte);
+        if(recycling)
+            add_leaf(prefix, byte);
+
+        else if(adaptive && dictionary.full())
+        {
+            check_ratio();
+            dictionary.select(0);
+        }
+
+        else
+            dictionary.add_suffix(byte);
+
         dictionary.step(byte, current_id);
     }
 
@@ -170,14 +276,12 @@ auto &LZW<LOG, DICTIONARY, OUTPUT>::decompress(INPUT input)
 #define END_SWITCH_SIZE_OPT {}
 #define CASE_SIZE_OPT(power)                                \
     if(dictionary.size() < (1U << power) - 1)               \
-    {                                                       \
-        LZWCode<power> code{1};                             \
-        input.read_bits((uchar_t *) &code, code.bitsize()); \
-        if(input.good())                                    \
-            decompress_code(code);                          \
-    } else
+        decompress_codes<power>(input);                     \
+    else
 
-    while(good() && input.good())
+    uint64_t start = history.position();
+    history.index(dictionary);
+    while(good() && !finished && input.good())
     {
         SWITCH_SIZE_OPT_BODY
     }
@@ -185,6 +289,39 @@ auto &LZW<LOG, DICTIONARY, OUTPUT>::decompress(INPUT input)
 #undef SWITCH_SIZE_OPT
 #undef END_SWITCH_SIZE_OPT
 #undef CASE_SIZE_OPT
+    history.flush();
+    bytes += history.position() - start;
+    return *this;
+}
+
+// The last code is only written by flush()
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZW<LOG, DICTIONARY, OUTPUT>::collect(Stats &stats) const
+{
+    stats.codes += codes + !!current_id;
+    stats.phrase_bytes += bytes;
+    ::collect(stats, dictionary);
+    ::collect(stats, output);
+}
+
+// Codes have the same width until the dictionary grows past the next power
+// of two or is cleared, so the width is only dispatched on when it changes
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+template<int BITS, typename INPUT>
+inline
+auto &LZW<LOG, DICTIONARY, OUTPUT>::decompress_codes(INPUT &input)
+{
+    const size_t lower = (1U << (BITS - 1)) - 1;
+    const size_t upper = (1U << BITS) - 1;
+    while(good() && !finished && input.good() && lower <= dictionary.size() && dictionary.size() < upper)
+    {
+        LZWCode<BITS> code{1};
+        input.read_bits((uchar_t *) &code, code.bitsize());
+        if(input.good())
+            decompress_code(code);
+    }
+
     return *this;
 }
 
@@ -193,52 +330,131 @@ template<int BITS>
 inline
 auto &LZW<LOG, DICTIONARY, OUTPUT>::decompress_code(const LZWCode<BITS> &code)
 {
-    log(log.DEBUG)  << "Decompressing " << code;
-    log(log.DEBUG)  << "Current dictionary size=" << dictionary.size()
-                    << " previous_id=" << previous_id;
-    assert(code.get_id());
-    std::vector<uchar_t> data = dictionary.jump(code.get_id());
-    if(data.empty())
+    ++ codes;
+    if(log.enabled(log.DEBUG))
+    {
+        log(log.DEBUG)  << "Decompressing " << code;
+        log(log.DEBUG)  << "Current dictionary size=" << dictionary.size()
+                        << " previous_id=" << previous_id;
+    }
+
+    if(recycling)
+    {
+        // The element this code adds: the next id, or the leaf about to get
+        // a new phrase once the dictionary is full. Like the next id, that
+        // leaf can already be used by this code.
+        size_t id = code.get_id();
+        size_t added = 0;
+        if(previous_id)
+            added = dictionary.full() ? recycler.victim(previous_id) : dictionary.size() + 1;
+
+        if(!id || (id > dictionary.size() && id != added))
+        {
+            if(log.enabled(log.DEBUG))
+                log(log.DEBUG) << "Invalid code, end of data";
+
+            finished = true;
+            return *this;
+        }
+
+        uint64_t offset = history.position();
+        if(id == added)
+        {
+            history.copy(dictionary, previous_id);
+            history.put(history.at(offset));
+        }
+
+        else
+            history.copy(dictionary, id);
+
+        if(added)
+        {
+            size_t length = history.size(previous_id) + 1;
+            add_leaf(previous_id, history.at(offset));
+            history.record(added, previous_offset, length);
+        }
+
+        recycler.touch(id);
+        previous_id = id;
+        previous_offset = offset;
+        return *this;
+    }
+
+    if(adaptive && dictionary.full() && code.get_id() && code.get_id() <= dictionary.size() + 1)
     {
-        assert(code.get_id() == dictionary.size() + 1);
-        log(log.DEBUG) << "Empty?";
-        data = dictionary.jump(previous_id);
-        assert(data.size() > 0);
-        if(!simulation)
+        previous_id = 0;
+        if(code.get_id() > dictionary.size())
         {
-            output.write((char *) &data[0], data.size() * sizeof(uchar_t));
-            output.write((char *) &data[0], sizeof(uchar_t));
+            if(log.enabled(log.DEBUG))
+                log(log.DEBUG) << "Clear code";
+
+            dictionary.clear();
+            return *this;
         }
 
-        dictionary.add_suffix(data[0]);
+        // Nothing is added to a full dictionary
+        history.copy(dictionary, code.get_id());
+        return *this;
+    }
+
+    if(!code.get_id() || code.get_id() > dictionary.size() + !!previous_id)
+    {
+        // Padding of the last byte can decode into one more code, nothing
+        // valid can follow it
+        if(log.enabled(log.DEBUG))
+            log(log.DEBUG) << "Invalid code, end of data";
+
+        finished = true;
+        return *this;
+    }
+
+    uint64_t offset = history.position();
+    if(code.get_id() > dictionary.size())
+    {
+        if(log.enabled(log.DEBUG))
+            log(log.DEBUG) << "Empty?";
+
+        history.copy(dictionary, previous_id);
+        uchar_t first = history.at(offset);
+        history.put(first);
+
+        dictionary.select(previous_id);
+        dictionary.add_suffix(first);
         if(dictionary.empty())
             previous_id = 0;
 
         else
+        {
+            history.record(code.get_id(), offset, history.size(previous_id) + 1);
             previous_id = code.get_id();
+            previous_offset = offset;
+        }
 
         return *this;
     }
 
-    if(!simulation)
-        output.write((char *) &data[0], data.size() * sizeof(uchar_t));
-
+    history.copy(dictionary, code.get_id());
     if(previous_id)
     {
-        std::vector<uchar_t> test = dictionary.jump(previous_id);
-        assert(test.size() > 0);
-        dictionary.add_suffix(data[0]);
+        size_t length = history.size(previous_id) + 1;
+        dictionary.select(previous_id);
+        dictionary.add_suffix(history.at(offset));
 
         if(dictionary.empty())
             previous_id = 0;
 
         else
+        {
+            history.record(dictionary.size(), previous_offset, length);
             previous_id = code.get_id();
+            previous_offset = offset;
+        }
 
         return *this;
     }
 
     previous_id = code.get_id();
+    previous_offset = offset;
     return *this;
 }
 
@@ -246,25 +462,103 @@ template<typename LOG, typename DICTIONARY, typename OUTPUT>
 inline
 void LZW<LOG, DICTIONARY, OUTPUT>::write_current_code(void)
 {
-#define SWITCH_SIZE_OPT     if(false) {} else
-#define END_SWITCH_SIZE_OPT {}
-#define CASE_SIZE_OPT(power)                                        \
-    if(dictionary.size() < (1U << power))                           \
-    {                                                               \
-        LZWCode<power> code{current_id};                            \
-        log(log.DEBUG) << "Current dictionary size=" << dictionary.size(); \
-        log(log.DEBUG) << "Part compressed into " << code;          \
-        if(!simulation)                                             \
-            output.write_bits((uchar_t*) &code, code.bitsize());    \
-    } else
-
-    SWITCH_SIZE_OPT_BODY
+    // Code width follows the dictionary size: one more bit past each power
+    // of two, back to the start when the dictionary is cleared
+    size_t size = dictionary.size();
+    while(size >= (size_t) 1 << code_bits)
+        ++ code_bits;
 
-#undef SWITCH_SIZE_OPT
-#undef END_SWITCH_SIZE_OPT
-#undef CASE_SIZE_OPT
+    while(code_bits > 1 && size < (size_t) 1 << (code_bits - 1))
+        -- code_bits;
+
+    if(log.enabled(log.DEBUG))
+    {
+        log(log.DEBUG) << "Current dictionary size=" << size;
+        log(log.DEBUG) << "Part compressed into " << current_id << " (" << code_bits << " bits)";
+    }
+
+    if(!simulation)
+        output.append(current_id, code_bits);
+
+    ++ codes;
+
+    if(recycling)
+        recycler.touch(current_id);
 
+    window_bits += code_bits;
     current_id = 0;
 }
 
+// Called between codes while the dictionary is full. The first call ends
+// the fill phase, its ratio is roughly what clearing would give back.
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+void LZW<LOG, DICTIONARY, OUTPUT>::check_ratio(void)
+{
+    if(!frozen)
+    {
+        fill_ratio = 8.0 * window_bytes / window_bits;
+        window_bytes = 0;
+        window_bits = 0;
+        frozen = true;
+        return;
+    }
+
+    if(window_bytes < CHECK_WINDOW)
+        return;
+
+    double ratio = 8.0 * window_bytes / window_bits;
+    window_bytes = 0;
+    window_bits = 0;
+    if(ratio >= 1 && ratio >= fill_ratio && ratio >= best_ratio * (1 - RESET_DROP))
+    {
+        best_ratio = ratio > best_ratio ? ratio : best_ratio;
+        return;
+    }
+
+    if(log.enabled(log.DEBUG))
+        log(log.DEBUG) << "Ratio " << ratio << " (best " << best_ratio << ", fill " << fill_ratio << "), clearing dictionary";
+
+    // A full dictionary holds 2^b / sizeof(Element) elements, about 0.8 of a
+    // power of two, so CLEAR never needs more bits than its last element
+    assert(dictionary.size() + 1 < (size_t) 1 << code_bits);
+
+    current_id = dictionary.size() + 1;
+    write_current_code();
+    dictionary.clear();
+    window_bits = 0;
+    best_ratio = 0;
+    frozen = false;
+}
+
+// Adds suffix byte of prefix in recycling mode and returns its id, 0 when
+// there is no leaf to spare
+template<typename LOG, typename DICTIONARY, typename OUTPUT>
+inline
+size_t LZW<LOG, DICTIONARY, OUTPUT>::add_leaf(size_t prefix, uchar_t byte)
+{
+    dictionary.select(prefix);
+    if(!dictionary.full())
+    {
+        dictionary.add_suffix(byte);
+        recycler.add(dictionary.size(), prefix);
+        return dictionary.size();
+    }
+
+    size_t id = recycler.victim(prefix);
+    if(!id)
+    {
+        dictionary.select(0);
+        return 0;
+    }
+
+    if(log.enabled(log.DEBUG))
+        log(log.DEBUG) << "Recycling " << id;
+
+    recycler.remove(id, dictionary.get_prev(id));
+    dictionary.recycle(id, byte);
+    recycler.add(id, prefix);
+    return id;
+}
+
 #endif // __LZW_H__
@@ -0,0 +1,133 @@
+#ifndef __MEMORY_STREAM_H__
+#define __MEMORY_STREAM_H__
+
+#include <cstdint>
+#include <cstring>
+
+typedef unsigned char uchar_t;
+
+// Stream writing into a caller's buffer. Writes past its capacity are
+// dropped and leave the sink failed, so the caller can tell the result did
+// not fit.
+class MemorySink
+{
+    uchar_t     *data;
+    size_t      capacity;
+    size_t      used;
+    bool        overflow;
+
+public:
+    MemorySink(uchar_t *_data=nullptr, size_t _capacity=0);
+
+    void reset(uchar_t *_data, size_t _capacity);
+    bool good(void) const;
+    size_t size(void) const;
+
+    void write(const char *buffer, size_t bytes);
+}; // class MemorySink
+
+// Stream reading from a caller's buffer, ends like std::istream: a read
+// that comes up short marks the end of input.
+class MemorySource
+{
+    const uchar_t   *data;
+    size_t          size;
+    size_t          position;
+    size_t          last_count;
+    bool            eof;
+
+public:
+    MemorySource(const uchar_t *_data=nullptr, size_t _size=0);
+
+    void reset(const uchar_t *_data, size_t _size);
+    bool good(void) const;
+
+    void read(char *buffer, size_t bytes);
+    size_t gcount(void) const;
+}; // class MemorySource
+
+inline
+MemorySink::MemorySink(uchar_t *_data, size_t _capacity)
+:data{_data}
+,capacity{_capacity}
+,used{0}
+,overflow{false}
+{
+}
+
+inline
+void MemorySink::reset(uchar_t *_data, size_t _capacity)
+{
+    data = _data;
+    capacity = _capacity;
+    used = 0;
+    overflow = false;
+}
+
+inline
+bool MemorySink::good(void) const
+{
+    return !overflow;
+}
+
+inline
+size_t MemorySink::size(void) const
+{
+    return used;
+}
+
+inline
+void MemorySink::write(const char *buffer, size_t bytes)
+{
+    if(overflow || bytes > capacity - used)
+    {
+        overflow = true;
+        return;
+    }
+
+    memcpy(data + used, buffer, bytes);
+    used += bytes;
+}
+
+inline
+MemorySource::MemorySource(const uchar_t *_data, size_t _size)
+:data{_data}
+,size{_size}
+,position{0}
+,last_count{0}
+,eof{false}
+{
+}
+
+inline
+void MemorySource::reset(const uchar_t *_data, size_t _size)
+{
+    data = _data;
+    size = _size;
+    position = 0;
+    last_count = 0;
+    eof = false;
+}
+
+inline
+bool MemorySource::good(void) const
+{
+    return !eof;
+}
+
+inline
+void MemorySource::read(char *buffer, size_t bytes)
+{
+    last_count = size - position < bytes ? size - position : bytes;
+    memcpy(buffer, data + position, last_count);
+    position += last_count;
+    eof = last_count < bytes;
+}
+
+inline
+size_t MemorySource::gcount(void) const
+{
+    return last_count;
+}
+
+#endif // __MEMORY_STREAM_H__
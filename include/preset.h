@@ -0,0 +1,212 @@
+#ifndef __PRESET_H__
+#define __PRESET_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "checksum.h"
+#include "dictionary.h"
+#include "header.h"
+
+// Trained starting point for LZW: phrases learned from sample data, added
+// on top of the prepopulated alphabet, and byte counts of the codes they
+// produced, which prime the FGK tree. Stored as:
+//      offset  size    field
+//      0       4       magic "LZKP"
+//      4       1       format version (1)
+//      5       4       number of elements
+//      9       5*n     elements: prefix id (4), byte (1)
+//      ..      512     FGK priming count of every byte value (2 each)
+//
+// Element prefixes are dictionary ids, so every prefix comes before its
+// suffixes. A stream refers to its preset by id - Adler-32 of the file.
+const char      PRESET_MAGIC[4] = {'L', 'Z', 'K', 'P'};
+const uint8_t   PRESET_VERSION = 1;
+
+struct Preset
+{
+    // Priming counts add up to at most this, more would make the tree slow
+    // to follow the actual data
+    static const size_t     PRIME_TOTAL = 1024;
+
+    std::vector<uint32_t>   prev;
+    std::vector<uchar_t>    byte;
+    std::vector<uint16_t>   counts;
+    uint32_t                id;
+
+    Preset(void);
+
+    size_t size(void) const;
+    void add(size_t _prev, uchar_t _byte);
+    void prime(const std::vector<uint64_t> &histogram);
+
+    void write(std::ostream &stream);
+    bool read(std::istream &stream);
+
+private:
+    std::string serialize(void) const;
+}; // struct Preset
+
+// Prepopulated dictionary that also starts with (and clears back to) the
+// elements of a preset. Without one it is just PrepopulatedDictionary<256>.
+template<typename BASE=Dictionary>
+class PresetDictionary: public PrepopulatedDictionary<256, BASE>
+{
+    size_t  preset_size;
+
+public:
+    template<typename... ARGS>
+    PresetDictionary(const Preset *_preset, size_t _size_limit, ARGS... _args);
+
+    void clear(void) override;
+    bool empty(void) const;
+}; // class PresetDictionary
+
+inline
+Preset::Preset(void)
+:prev{}
+,byte{}
+,counts(256)
+,id{0}
+{
+}
+
+inline
+size_t Preset::size(void) const
+{
+    return prev.size();
+}
+
+inline
+void Preset::add(size_t _prev, uchar_t _byte)
+{
+    prev.push_back(_prev);
+    byte.push_back(_byte);
+}
+
+// Scales histogram down to PRIME_TOTAL, every byte value seen keeps at
+// least a count of one
+inline
+void Preset::prime(const std::vector<uint64_t> &histogram)
+{
+    uint64_t total = 0;
+    for(uint64_t count: histogram)
+        total += count;
+
+    for(size_t value = 0; value < 256; ++ value)
+    {
+        uint64_t count = total > PRIME_TOTAL ? histogram[value] * PRIME_TOTAL / total : histogram[value];
+        counts[value] = histogram[value] && !count ? 1 : count;
+    }
+}
+
+inline
+std::string Preset::serialize(void) const
+{
+    std::string data(9 + 5 * size() + 2 * 256, 0);
+    uchar_t *current = (uchar_t *) &data[0];
+    std::copy(PRESET_MAGIC, PRESET_MAGIC + sizeof(PRESET_MAGIC), current);
+    current[4] = PRESET_VERSION;
+    put_le(current + 5, size(), 4);
+    current += 9;
+    for(size_t e = 0; e < size(); ++ e, current += 5)
+    {
+        put_le(current, prev[e], 4);
+        current[4] = byte[e];
+    }
+
+    for(size_t value = 0; value < 256; ++ value, current += 2)
+        put_le(current, counts[value], 2);
+
+    return data;
+}
+
+// Also sets the id of the preset
+inline
+void Preset::write(std::ostream &stream)
+{
+    std::string data = serialize();
+    Adler32 checksum;
+    checksum.update((const uchar_t *) data.data(), data.size());
+    id = checksum.value();
+    stream.write(data.data(), data.size());
+}
+
+// False when the file is not a valid preset
+inline
+bool Preset::read(std::istream &stream)
+{
+    std::string data{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+    const uchar_t *current = (const uchar_t *) data.data();
+    if(data.size() < 9 || !std::equal(PRESET_MAGIC, PRESET_MAGIC + sizeof(PRESET_MAGIC), data.data()) || current[4] != PRESET_VERSION)
+        return false;
+
+    size_t elements = get_le(current + 5, 4);
+    if(data.size() != 9 + 5 * elements + 2 * 256)
+        return false;
+
+    prev.clear();
+    byte.clear();
+    current += 9;
+    for(size_t e = 0; e < elements; ++ e, current += 5)
+    {
+        size_t _prev = get_le(current, 4);
+        if(!_prev || _prev > 256 + e)
+            return false;
+
+        add(_prev, current[4]);
+    }
+
+    for(size_t value = 0; value < 256; ++ value, current += 2)
+        counts[value] = get_le(current, 2);
+
+    Adler32 checksum;
+    checksum.update((const uchar_t *) data.data(), data.size());
+    id = checksum.value();
+    return true;
+}
+
+template<typename BASE>
+template<typename... ARGS>
+inline
+PresetDictionary<BASE>::PresetDictionary(const Preset *_preset, size_t _size_limit, ARGS... _args)
+:PrepopulatedDictionary<256, BASE>{_size_limit, _args...}
+,preset_size{256}
+{
+    if(!_preset)
+        return;
+
+    for(size_t e = 0; e < _preset->size() && !this->full(); ++ e)
+    {
+        this->select(_preset->prev[e]);
+        this->add_suffix(_preset->byte[e]);
+    }
+
+    // The decoder has to end up with exactly the same elements, a repeated
+    // one would only be added there
+    if(this->size() != 256 + _preset->size())
+        throw std::runtime_error("Preset dictionary is invalid or too big for dictionary size");
+
+    preset_size = this->size();
+}
+
+template<typename BASE>
+inline
+void PresetDictionary<BASE>::clear(void)
+{
+    this->truncate(preset_size);
+}
+
+template<typename BASE>
+inline
+bool PresetDictionary<BASE>::empty(void) const
+{
+    return this->size() == preset_size;
+}
+
+#endif // __PRESET_H__
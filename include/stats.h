@@ -0,0 +1,243 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Dictionary resets and the dictionary sizes they happened at. A long run
+// may reset thousands of times, so only the extremes and the last one are
+// kept.
+struct Resets
+{
+    uint64_t    count;
+    size_t      min;
+    size_t      max;
+    size_t      last;
+
+    Resets(void);
+
+    void add(size_t size);
+    void merge(const Resets &other);
+}; // struct Resets
+
+// Counters of a (de)compression run. Codec parts keep plain counters of
+// their own, bumped next to work they do anyway, and are collected into
+// Stats once they are done - nothing is shared or locked on the hot paths.
+struct Stats
+{
+    struct Stage
+    {
+        std::string name;
+        double      wall;
+        double      cpu;
+    }; // struct Stage
+
+    uint64_t                bytes_in;
+    uint64_t                bytes_out;
+    uint64_t                phrase_bytes;   // uncompressed bytes covered by codes
+    uint64_t                codes;
+    uint64_t                steps;          // Dictionary::step calls
+    uint64_t                probes;         // tree nodes they looked at
+    uint64_t                escapes;        // new bytes sent by AdaptiveHuffman
+    uint64_t                swaps;          // AdaptiveHuffman::exchange calls that swapped
+    Resets                  resets;
+    std::vector<Stage>      stages;
+
+    Stats(void);
+
+    void merge(const Stats &other);
+    void add_stage(const std::string &name, double wall, double cpu);
+
+    void write(std::ostream &stream) const;
+    void write_json(std::ostream &stream) const;
+}; // struct Stats
+
+// Wall and CPU time since construction. CPU time is the calling thread's,
+// or the whole process's with _process.
+class StageTimer
+{
+    std::chrono::steady_clock::time_point   wall;
+    double                                  cpu;
+    clockid_t                               clock;
+
+public:
+    StageTimer(bool _process=false);
+
+    void stop(Stats &stats, const std::string &name) const;
+
+private:
+    double cpu_time(void) const;
+}; // class StageTimer
+
+// Parts with counters have a collect(Stats &) member, the rest has nothing
+// to add
+template<typename PART>
+inline
+auto collect(Stats &stats, const PART &part, int) -> decltype(part.collect(stats))
+{
+    return part.collect(stats);
+}
+
+template<typename PART>
+inline
+void collect(Stats &, const PART &, long)
+{
+}
+
+template<typename PART>
+inline
+void collect(Stats &stats, const PART &part)
+{
+    collect(stats, part, 0);
+}
+
+inline
+Resets::Resets(void)
+:count{0}
+,min{0}
+,max{0}
+,last{0}
+{
+}
+
+inline
+void Resets::add(size_t size)
+{
+    min = !count || size < min ? size : min;
+    max = !count || size > max ? size : max;
+    last = size;
+    ++ count;
+}
+
+// other is collected after this one, with blocks on threads that is the
+// one that finished later
+inline
+void Resets::merge(const Resets &other)
+{
+    if(!other.count)
+        return;
+
+    min = !count || other.min < min ? other.min : min;
+    max = !count || other.max > max ? other.max : max;
+    last = other.last;
+    count += other.count;
+}
+
+inline
+Stats::Stats(void)
+:bytes_in{0}
+,bytes_out{0}
+,phrase_bytes{0}
+,codes{0}
+,steps{0}
+,probes{0}
+,escapes{0}
+,swaps{0}
+,resets{}
+,stages{}
+{
+}
+
+inline
+void Stats::merge(const Stats &other)
+{
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    phrase_bytes += other.phrase_bytes;
+    codes += other.codes;
+    steps += other.steps;
+    probes += other.probes;
+    escapes += other.escapes;
+    swaps += other.swaps;
+    resets.merge(other.resets);
+    for(const Stage &stage: other.stages)
+        add_stage(stage.name, stage.wall, stage.cpu);
+}
+
+// Times of a stage that ran more than once (blocks) add up
+inline
+void Stats::add_stage(const std::string &name, double wall, double cpu)
+{
+    for(Stage &stage: stages)
+        if(stage.name == name)
+        {
+            stage.wall += wall;
+            stage.cpu += cpu;
+            return;
+        }
+
+    stages.push_back(Stage{name, wall, cpu});
+}
+
+inline
+void Stats::write(std::ostream &stream) const
+{
+    stream  << "bytes in:       " << bytes_in << "\n"
+            << "bytes out:      " << bytes_out << "\n"
+            << "codes:          " << codes << "\n"
+            << "phrase length:  " << (codes ? (double) phrase_bytes / codes : 0) << "\n"
+            << "step depth:     " << (steps ? (double) probes / steps : 0) << "\n"
+            << "escapes:        " << escapes << "\n"
+            << "swaps:          " << swaps << "\n"
+            << "resets:         " << resets.count;
+
+    if(resets.count)
+        stream << " (size min " << resets.min << ", max " << resets.max << ", last " << resets.last << ")";
+
+    stream << "\n";
+    for(const Stage &stage: stages)
+        stream << stage.name << ":" << std::string(stage.name.size() < 15 ? 15 - stage.name.size() : 1, ' ')
+               << stage.wall << "s wall, " << stage.cpu << "s cpu\n";
+}
+
+inline
+void Stats::write_json(std::ostream &stream) const
+{
+    stream  << "{\"bytes_in\":" << bytes_in
+            << ",\"bytes_out\":" << bytes_out
+            << ",\"codes\":" << codes
+            << ",\"phrase_length\":" << (codes ? (double) phrase_bytes / codes : 0)
+            << ",\"step_depth\":" << (steps ? (double) probes / steps : 0)
+            << ",\"escapes\":" << escapes
+            << ",\"swaps\":" << swaps
+            << ",\"resets\":{\"count\":" << resets.count
+            << ",\"min\":" << resets.min
+            << ",\"max\":" << resets.max
+            << ",\"last\":" << resets.last
+            << "},\"stages\":{";
+    for(size_t s = 0; s < stages.size(); ++ s)
+        stream  << (s ? "," : "") << "\"" << stages[s].name << "\":{\"wall\":" << stages[s].wall
+                << ",\"cpu\":" << stages[s].cpu << "}";
+
+    stream << "}}\n";
+}
+
+inline
+StageTimer::StageTimer(bool _process)
+:wall{std::chrono::steady_clock::now()}
+,cpu{0}
+,clock{_process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID}
+{
+    cpu = cpu_time();
+}
+
+inline
+void StageTimer::stop(Stats &stats, const std::string &name) const
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - wall;
+    stats.add_stage(name, elapsed.count(), cpu_time() - cpu);
+}
+
+inline
+double StageTimer::cpu_time(void) const
+{
+    timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#endif // __STATS_H__
@@ -0,0 +1,528 @@
+#ifndef __VITTER_HUFFMAN_H__
+#define __VITTER_HUFFMAN_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+typedef unsigned char uchar_t;
+
+// Run of consecutive positions holding nodes of the same weight and kind
+struct Block
+{
+    uint64_t    weight;
+    uint16_t    first;
+    uint16_t    last; // leader
+    bool        leaf;
+}; // struct Block
+
+// Dynamic Huffman coding with Vitter's algorithm Lambda.
+//
+// Nodes are kept in their implicit numbering: position ROOT is the root,
+// siblings occupy positions (2k, 2k + 1) with the right child on the odd one
+// and the escape node is always on the lowest position. Positions are fixed
+// in the tree (parent of a position only changes when the node living there
+// gets new children), nodes move between them.
+//
+// Every position belongs to a block of nodes with equal weight and kind,
+// blocks are ordered by weight and within same weight leaves come before
+// internal nodes. Leader (highest position) of a block is therefore found in
+// constant time and an update never scans for it.
+template<typename BITSTREAM>
+class VitterHuffman
+{
+    static const uint16_t   ROOT = 512;
+
+    BITSTREAM               stream;
+
+    // Indexed by position
+    std::vector<uint64_t>   weight;
+    std::vector<uint16_t>   right; // right child, left is right - 1, 0 for leaves
+    std::vector<uint16_t>   parent;
+    std::vector<uchar_t>    symbol;
+    std::vector<uint16_t>   block;
+
+    std::vector<Block>      blocks;
+    std::vector<uint16_t>   free_blocks;
+
+    uint16_t                null;
+    std::vector<uint16_t>   byte2node;
+
+    // Decoder state, input is buffered here instead of being pulled from
+    // the stream bit by bit
+    uint64_t    bits;
+    size_t      bits_size;
+    bool        eof;
+    bool        overrun;
+
+    size_t      last_count;
+    bool        written;
+
+public:
+    VitterHuffman(BITSTREAM _stream);
+    ~VitterHuffman(void);
+
+    void flush(void);
+
+    bool good(void) const;
+
+    void write(char *buffer, size_t bytes);
+    void read(char *buffer, size_t bytes);
+
+    bool put(uchar_t byte);
+    bool get(char &byte);
+
+    size_t gcount(void) const;
+
+private:
+    void get_code(uint16_t current, uchar_t *code, size_t &size);
+    void refill(void);
+    void consume(size_t count);
+
+    void update(uchar_t byte);
+    uint16_t slide_and_increment(uint16_t current);
+    void exchange(uint16_t a, uint16_t b);
+    void join(uint16_t current);
+    void leave(uint16_t current);
+#ifndef NDEBUG
+    bool validate_tree(void);
+#endif
+}; // class VitterHuffman
+
+template<typename BITSTREAM>
+inline
+VitterHuffman<BITSTREAM>::VitterHuffman(BITSTREAM _stream)
+:stream{_stream}
+,weight(ROOT + 1)
+,right(ROOT + 1)
+,parent(ROOT + 1)
+,symbol(ROOT + 1)
+,block(ROOT + 1)
+,blocks{}
+,free_blocks{}
+,null{ROOT}
+,byte2node(256)
+,bits{0}
+,bits_size{0}
+,eof{false}
+,overrun{false}
+,last_count{0}
+,written{false}
+{
+    blocks.reserve(ROOT + 2);
+    free_blocks.reserve(ROOT + 2);
+    blocks.push_back({0, 0, 0, false}); // block 0 is never used
+    join(null);
+}
+
+template<typename BITSTREAM>
+inline
+VitterHuffman<BITSTREAM>::~VitterHuffman(void)
+{
+    flush();
+}
+
+// Encoded data ends with an escape code missing its byte, so the padding of
+// the last byte runs out of input in the decoder instead of decoding into
+// more symbols.
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::flush(void)
+{
+    if(!written)
+        return;
+
+    uchar_t code[64];
+    size_t size = 0;
+    get_code(null, code, size);
+    stream.write_bits(code, size);
+    written = false;
+}
+
+template<typename BITSTREAM>
+inline
+bool VitterHuffman<BITSTREAM>::good(void) const
+{
+    // Running out of input while reading ahead is not an error until the
+    // missing bits are actually needed
+    if(eof)
+        return !overrun;
+
+    return stream.good();
+}
+
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::write(char *buffer, size_t bytes)
+{
+    last_count = 0;
+    size_t count = bytes;
+    while(bytes --)
+        if(!put(*buffer ++))
+            return;
+
+    last_count = count;
+}
+
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::read(char *buffer, size_t bytes)
+{
+    last_count = 0;
+    size_t count = bytes;
+    while(bytes --)
+        if(!get(*buffer ++))
+        {
+            last_count = count - bytes - 1;
+            return;
+        }
+
+    last_count = count;
+}
+
+template<typename BITSTREAM>
+inline
+bool VitterHuffman<BITSTREAM>::put(uchar_t byte)
+{
+    last_count = 0;
+    uchar_t code[64];
+    size_t size = 0;
+    if(byte2node[byte])
+    {
+        get_code(byte2node[byte], code, size);
+        stream.write_bits(code, size);
+    }
+
+    else
+    {
+        get_code(null, code, size);
+        stream.write_bits(code, size);
+        stream.write((char*) &byte, 1);
+    }
+
+    update(byte);
+    written = true;
+    last_count = 1;
+    return true;
+}
+
+template<typename BITSTREAM>
+inline
+bool VitterHuffman<BITSTREAM>::get(char &byte)
+{
+    last_count = 0;
+    uint16_t current = ROOT;
+    while(right[current])
+    {
+        if(!bits_size)
+            refill();
+
+        current = right[current] - !(bits & 1);
+        consume(1);
+    }
+
+    if(overrun)
+        return false;
+
+    if(current == null)
+    {
+        if(bits_size < 8)
+            refill();
+
+        if(bits_size < 8)
+        {
+            overrun = true;
+            return false;
+        }
+
+        byte = bits & 0xFF;
+        consume(8);
+    }
+
+    else
+        byte = symbol[current];
+
+    update(byte);
+    last_count = 1;
+    return true;
+}
+
+template<typename BITSTREAM>
+inline
+size_t VitterHuffman<BITSTREAM>::gcount(void) const
+{
+    return last_count;
+}
+
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::get_code(uint16_t current, uchar_t *code, size_t &size)
+{
+    bool bit[257];
+    size_t bits = 0;
+    while(current != ROOT)
+    {
+        assert(bits < 257);
+        bit[bits ++] = current & 1;
+        current = parent[current];
+    }
+
+    size = bits;
+    size_t c = 0;
+    size_t b = 8;
+    while(bits --)
+    {
+        assert(c < 64);
+        if(b == 8)
+        {
+            code[c ++] = 0;
+            b = 0;
+        }
+
+        code[c - 1] |= (bit[bits] << b);
+        ++ b;
+    }
+}
+
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::refill(void)
+{
+    while(bits_size + 8 <= 64 && !eof)
+    {
+        uchar_t input[8];
+        size_t wanted = (64 - bits_size) / 8;
+        stream.read((char *) input, wanted);
+        size_t count = stream.gcount();
+        for(size_t i = 0; i < count; ++ i)
+        {
+            bits |= (uint64_t) input[i] << bits_size;
+            bits_size += 8;
+        }
+
+        eof = count < wanted;
+    }
+}
+
+// Past the end of input all bits read as zero
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::consume(size_t count)
+{
+    if(count > bits_size)
+    {
+        overrun = true;
+        count = bits_size;
+    }
+
+    bits = count < 64 ? bits >> count : 0;
+    bits_size -= count;
+}
+
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::update(uchar_t byte)
+{
+    uint16_t leaf_to_increment = 0;
+    uint16_t current = byte2node[byte];
+    if(!current)
+    {
+        // Escape node gets two children: new escape and leaf for byte
+        current = null;
+        null -= 2;
+        leave(current);
+        right[current] = current - 1;
+        parent[current - 1] = parent[null] = current;
+        weight[current - 1] = weight[null] = 0;
+        right[current - 1] = right[null] = 0;
+        symbol[current - 1] = byte;
+        byte2node[byte] = current - 1;
+        join(current);
+        join(current - 1);
+        join(null);
+        leaf_to_increment = current - 1;
+    }
+
+    else
+    {
+        uint16_t leader = blocks[block[current]].last;
+        if(leader != current)
+        {
+            std::swap(symbol[current], symbol[leader]);
+            byte2node[symbol[current]] = current;
+            byte2node[symbol[leader]] = leader;
+            current = leader;
+        }
+
+        if(current == null + 1)
+        {
+            leaf_to_increment = current;
+            current = parent[current];
+        }
+    }
+
+    while(current)
+        current = slide_and_increment(current);
+
+    if(leaf_to_increment)
+        slide_and_increment(leaf_to_increment);
+
+    assert(validate_tree());
+}
+
+// Increments weight of current (leader of its block), first moving it past
+// the next block if that block would otherwise break the ordering. Returns
+// node to be incremented next.
+template<typename BITSTREAM>
+inline
+uint16_t VitterHuffman<BITSTREAM>::slide_and_increment(uint16_t current)
+{
+    // Sliding by exchange reorders nodes within blocks, so current does not
+    // have to be the leader anymore
+    uint16_t leader = blocks[block[current]].last;
+    if(leader != current)
+    {
+        assert(parent[current] != leader);
+        exchange(current, leader);
+        current = leader;
+    }
+
+    // Alone in its block and nothing of the next weight above, blocks stay
+    // as they are
+    Block &own = blocks[block[current]];
+    if(own.first == current && (current == ROOT || blocks[block[current + 1]].weight > weight[current] + 1))
+    {
+        ++ own.weight;
+        ++ weight[current];
+        return parent[current];
+    }
+
+    const bool leaf = !right[current];
+    const uint16_t former_parent = parent[current];
+    leave(current);
+    if(current < ROOT)
+    {
+        Block &next = blocks[block[current + 1]];
+        if(next.leaf != leaf && next.weight == weight[current] + !leaf)
+        {
+            // Slide ahead of the next block. Nodes within a block are
+            // interchangeable, so only its leader has to take our place
+            // instead of the whole block moving one position down.
+            uint16_t target = next.last;
+            exchange(current, target);
+            block[current] = block[target];
+            -- next.first;
+            -- next.last;
+            current = target;
+        }
+    }
+
+    ++ weight[current];
+    join(current);
+    return leaf ? parent[current] : former_parent;
+}
+
+// Exchanges nodes living on positions a and b, keeping links of their
+// children or their symbols in order
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::exchange(uint16_t a, uint16_t b)
+{
+    std::swap(weight[a], weight[b]);
+    std::swap(right[a], right[b]);
+    std::swap(symbol[a], symbol[b]);
+    for(uint16_t position: {a, b})
+        if(right[position])
+            parent[right[position]] = parent[right[position] - 1] = position;
+
+        else
+            byte2node[symbol[position]] = position;
+}
+
+// Attaches current to the block right above it (as its lowest node) or to
+// a new block
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::join(uint16_t current)
+{
+    const bool leaf = !right[current];
+    if(current < ROOT && block[current + 1])
+    {
+        Block &next = blocks[block[current + 1]];
+        if(next.weight == weight[current] && next.leaf == leaf && next.first == current + 1)
+        {
+            next.first = current;
+            block[current] = block[current + 1];
+            return;
+        }
+    }
+
+    uint16_t id;
+    if(!free_blocks.empty())
+    {
+        id = free_blocks.back();
+        free_blocks.pop_back();
+    }
+
+    else
+    {
+        id = blocks.size();
+        blocks.push_back({});
+    }
+
+    blocks[id] = {weight[current], current, current, leaf};
+    block[current] = id;
+}
+
+// Detaches current (the leader) from its block
+template<typename BITSTREAM>
+inline
+void VitterHuffman<BITSTREAM>::leave(uint16_t current)
+{
+    Block &own = blocks[block[current]];
+    assert(own.last == current);
+    if(own.first == current)
+        free_blocks.push_back(block[current]);
+
+    else
+        -- own.last;
+
+    block[current] = 0;
+}
+
+#ifndef NDEBUG
+template<typename BITSTREAM>
+inline
+bool VitterHuffman<BITSTREAM>::validate_tree(void)
+{
+    for(uint16_t position = null; position <= ROOT; ++ position)
+    {
+        Block &own = blocks[block[position]];
+        assert(block[position]);
+        assert(own.first <= position && position <= own.last);
+        assert(own.weight == weight[position]);
+        assert(own.leaf == !right[position]);
+        if(right[position])
+        {
+            assert(parent[right[position]] == position);
+            assert(parent[right[position] - 1] == position);
+            assert(weight[position] == weight[right[position]] + weight[right[position] - 1]);
+        }
+
+        else if(position != null)
+            assert(byte2node[symbol[position]] == position);
+
+        if(position < ROOT)
+        {
+            // Sibling property and leaves before internal nodes of same weight
+            assert(weight[position] <= weight[position + 1]);
+            assert(weight[position] < weight[position + 1] || !right[position] || right[position + 1]);
+        }
+    }
+
+    return true;
+}
+#endif // NDEBUG
+
+#endif // __VITTER_HUFFMAN_H__
@@ -0,0 +1,109 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running submitted jobs in submission order. Results
+// come back through futures, so the caller decides in which order to
+// consume them.
+class WorkerPool
+{
+    std::vector<std::thread>            workers;
+    std::deque<std::function<void()>>   jobs;
+    std::mutex                          mutex;
+    std::condition_variable             pending;
+    bool                                stopping;
+
+public:
+    WorkerPool(size_t threads);
+    ~WorkerPool(void);
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    size_t size(void) const;
+
+    template<typename FUNCTION>
+    auto submit(FUNCTION function) -> std::future<decltype(function())>;
+
+private:
+    void work(void);
+}; // class WorkerPool
+
+inline
+WorkerPool::WorkerPool(size_t threads)
+:workers{}
+,jobs{}
+,mutex{}
+,pending{}
+,stopping{false}
+{
+    workers.reserve(threads);
+    for(size_t t = 0; t < threads; ++ t)
+        workers.emplace_back(&WorkerPool::work, this);
+}
+
+// Finishes jobs already submitted before joining the threads
+inline
+WorkerPool::~WorkerPool(void)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+
+    pending.notify_all();
+    for(std::thread &worker: workers)
+        worker.join();
+}
+
+inline
+size_t WorkerPool::size(void) const
+{
+    return workers.size();
+}
+
+template<typename FUNCTION>
+inline
+auto WorkerPool::submit(FUNCTION function) -> std::future<decltype(function())>
+{
+    typedef decltype(function()) RESULT;
+    auto job = std::make_shared<std::packaged_task<RESULT()>>(std::move(function));
+    std::future<RESULT> result = job->get_future();
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        jobs.emplace_back([job] { (*job)(); });
+    }
+
+    pending.notify_one();
+    return result;
+}
+
+inline
+void WorkerPool::work(void)
+{
+    while(true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            pending.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if(jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+#endif // __WORKER_POOL_H__
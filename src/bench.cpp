@@ -0,0 +1,402 @@
+/* 2015
+ * Maciej Szeptuch
+ */
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <lz78/lz78.h>
+#include <lzw/lzw.h>
+#include <bitstream.h>
+#include <codec.h>
+#include <dictionary.h>
+#include <hash_dictionary.h>
+#include <adaptive_huffman.h>
+#include "log.h"
+#include "common.h"
+#include "fd_stream.h"
+
+const char *VERSION = "0.1.0";
+const char *HELP    = "Usage: bench [OPTION]... FILE...\n\
+Measure compression throughput of every dictionary engine on FILEs.\n\
+Startup is the time to set up the codec, peak RSS the memory it touched\n\
+and dTLB the data TLB read misses of the whole run (- when unavailable).\n\
+msg rows compress FILE cut into messages, each through a new codec with\n\
+its own streams or through one reused LZWContext, and report time per message.\n\
+io rows compress FILE read from disk into /dev/null, through std::ifstream and\n\
+std::ofstream or straight through FdSource and FdSink.\n\n\
+-b, --bitsize     dictionary bits (15-31, default=20)\n\
+-h, --help        give this help\n\
+-r, --repeat      number of runs per engine, best is reported (default=3)\n\
+-V, --version     display version number\n";
+const char *SHORT_OPTIONS = "b:hr:V";
+const struct option LONG_OPTIONS[] =
+{
+    {"bitsize",     required_argument,  nullptr, 'b'},
+    {"help",        no_argument,        nullptr, 'h'},
+    {"repeat",      required_argument,  nullptr, 'r'},
+    {"version",     no_argument,        nullptr, 'V'},
+    {nullptr, 0, nullptr, 0},
+};
+
+struct Result
+{
+    double      seconds;
+    double      startup;
+    size_t      peak_rss;
+    int64_t     tlb_misses; // -1 when not counted
+    std::string output;
+}; // struct Result
+
+// Counts data TLB read misses of this process in user space
+class TlbCounter
+{
+    int fd;
+
+public:
+    TlbCounter(void);
+    ~TlbCounter(void);
+
+    void start(void);
+    int64_t stop(void);
+}; // class TlbCounter
+
+TlbCounter::TlbCounter(void)
+:fd{-1}
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                | PERF_COUNT_HW_CACHE_OP_READ << 8
+                | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+TlbCounter::~TlbCounter(void)
+{
+    if(fd >= 0)
+        close(fd);
+}
+
+void TlbCounter::start(void)
+{
+    if(fd < 0)
+        return;
+
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+int64_t TlbCounter::stop(void)
+{
+    int64_t count = -1;
+    if(fd < 0)
+        return count;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if(read(fd, &count, sizeof(count)) != sizeof(count))
+        count = -1;
+
+    return count;
+}
+
+// Value of a VmXXX line from /proc/self/status in bytes
+size_t vm_status(const std::string &field)
+{
+    std::ifstream status{"/proc/self/status"};
+    std::string line;
+    while(std::getline(status, line))
+        if(line.compare(0, field.size() + 1, field + ":") == 0)
+            return std::stoull(line.substr(field.size() + 1)) << 10;
+
+    return 0;
+}
+
+// Makes VmHWM start again from the current RSS. Memory freed by earlier
+// runs is returned first, otherwise reusing it would not show up.
+void reset_peak_rss(void)
+{
+    malloc_trim(0);
+    std::ofstream clear_refs{"/proc/self/clear_refs"};
+    clear_refs << "5";
+}
+
+// Full dictionary policies, set up on the codec before compressing
+struct ClearWhenFull
+{
+    template<typename CODEC>
+    void operator()(CODEC &) const {}
+}; // struct ClearWhenFull
+
+struct AdaptiveReset
+{
+    template<typename CODEC>
+    void operator()(CODEC &codec) const { codec.adaptive_reset(); }
+}; // struct AdaptiveReset
+
+struct RecycleLeaves
+{
+    template<typename CODEC>
+    void operator()(CODEC &codec) const { codec.recycle_leaves(); }
+}; // struct RecycleLeaves
+
+template<template<typename, typename, typename> class CODEC, typename DICTIONARY, typename POLICY=ClearWhenFull, typename... ARGS>
+Result run(Log &log, const std::string &data, size_t dict_size, uint32_t repeat, ARGS... args)
+{
+    Result best{0, 0, 0, -1, ""};
+    TlbCounter tlb;
+    while(repeat --)
+    {
+        std::istringstream input{data};
+        std::ostringstream output;
+        reset_peak_rss();
+        size_t rss = vm_status("VmRSS");
+        tlb.start();
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> startup;
+        {
+            CODEC<Log &, DICTIONARY, BitHuffOut> codec{log, DICTIONARY{dict_size, args...}, BitHuffOut{HuffOut{BitOut{output}}}};
+            POLICY{}(codec);
+            startup = std::chrono::steady_clock::now() - start;
+            codec.compress(BitIn{input});
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        int64_t tlb_misses = tlb.stop();
+        size_t peak = vm_status("VmHWM");
+        if(!best.seconds || elapsed.count() < best.seconds)
+            best = {elapsed.count(), startup.count(), peak > rss ? peak - rss : 0, tlb_misses, output.str()};
+    }
+
+    return best;
+}
+
+// Microseconds per message of data cut into message sized pieces, output is
+// the total compressed size
+template<typename COMPRESS>
+double run_messages(const std::string &data, size_t message, uint32_t repeat, std::string &output, COMPRESS compress)
+{
+    double best = 0;
+    while(repeat --)
+    {
+        size_t total = 0;
+        size_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(size_t offset = 0; offset < data.size(); offset += message, ++ count)
+            total += compress((const uchar_t *) data.data() + offset, std::min(message, data.size() - offset));
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double cost = count ? elapsed.count() * 1e6 / count : 0;
+        if(!best || cost < best)
+            best = cost;
+
+        output = std::to_string(total);
+    }
+
+    return best;
+}
+
+// Seconds to compress input into output, with INPUT and OUTPUT as the
+// streams under BitReader and BitWriter
+template<typename INPUT, typename OUTPUT>
+double compress_file(Log &log, size_t dict_size, INPUT &input, OUTPUT &output)
+{
+    typedef BitWriter<OUTPUT &>         Bits;
+    typedef AdaptiveHuffman<Bits>       Huffman;
+    auto start = std::chrono::steady_clock::now();
+    {
+        LZW<Log &, PrepopulatedDictionary<256>, BitWriter<Huffman>> codec{log, PrepopulatedDictionary<256>{dict_size}, BitWriter<Huffman>{Huffman{Bits{output}}}};
+        codec.compress(BitReader<INPUT &>{input});
+    }
+
+    output.flush();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template<typename COMPRESS>
+double run_io(uint32_t repeat, COMPRESS compress)
+{
+    double best = 0;
+    while(repeat --)
+    {
+        double seconds = compress();
+        if(!best || seconds < best)
+            best = seconds;
+    }
+
+    return best;
+}
+
+void report_io(const std::string &name, const std::string &engine, const std::string &data, double seconds)
+{
+    std::cout   << std::left << std::setw(24) << name
+                << std::setw(12) << engine
+                << std::right << std::setw(12) << data.size()
+                << std::setw(12) << "-"
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << data.size() / seconds / (1 << 20) << " MB/s"
+                << "\n";
+}
+
+void report_messages(const std::string &name, const std::string &engine, const std::string &data, const std::string &output, double cost)
+{
+    std::cout   << std::left << std::setw(24) << name
+                << std::setw(12) << engine
+                << std::right << std::setw(12) << data.size()
+                << std::setw(12) << output
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << cost << " us/msg"
+                << "\n";
+}
+
+void report(const std::string &name, const std::string &engine, const std::string &data, const Result &result, const Result &reference)
+{
+    std::cout   << std::left << std::setw(24) << name
+                << std::setw(12) << engine
+                << std::right << std::setw(12) << data.size()
+                << std::setw(12) << result.output.size()
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << data.size() / result.seconds / (1 << 20) << " MB/s"
+                << std::setw(10) << result.startup * 1000 << " ms"
+                << std::setw(10) << (double) result.peak_rss / (1 << 20) << " MB"
+                << std::setw(14) << (result.tlb_misses < 0 ? "-" : std::to_string(result.tlb_misses))
+                << (result.output == reference.output ? "" : "  OUTPUT DIFFERS")
+                << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t bit_size   = 20;
+    uint32_t repeat     = 3;
+
+    Log log{std::cerr};
+    log.disable();
+
+    int o;
+    while((o = getopt_long(argc, argv, SHORT_OPTIONS, LONG_OPTIONS, 0)) != -1) switch(o)
+    {
+        case 'h': std::cout << HELP;
+            return 0;
+
+        case 'V': std::cout << "bench " << VERSION << "\n";
+            return 0;
+
+        case 'b':
+            bit_size = atoi(optarg);
+            break;
+
+        case 'r':
+            repeat = std::max(1, atoi(optarg));
+            break;
+
+        case '?':
+        default: std::cerr << HELP;
+            return 1;
+    }
+
+    if(bit_size < 15 || bit_size > 31)
+        throw std::runtime_error("Invalid bit_size for dictionary");
+
+    size_t dict_size = 1U << bit_size;
+    for(int f = optind; f < argc; ++ f)
+    {
+        std::string name = argv[f];
+        if(!file_exists(name))
+            throw std::runtime_error("Input file doesn't exist");
+
+        std::ifstream file{name, std::ifstream::in | std::ifstream::binary};
+        std::ostringstream content;
+        content << file.rdbuf();
+        std::string data = content.str();
+        if(name.size() > 16)
+            name = "..." + name.substr(name.size() - 13);
+
+        Result lzw_tree = run<LZW, PrepopulatedDictionary<256>>(log, data, dict_size, repeat);
+        Result lzw_hash = run<LZW, PrepopulatedDictionary<256, HashDictionary>>(log, data, dict_size, repeat);
+        Result lzw_huge = run<LZW, PrepopulatedDictionary<256>>(log, data, dict_size, repeat, true);
+        Result lzw_packed = run<LZW, PrepopulatedDictionary<256, PackedDictionary>>(log, data, dict_size, repeat);
+        Result lzw_adaptive = run<LZW, PrepopulatedDictionary<256>, AdaptiveReset>(log, data, dict_size, repeat);
+        Result lzw_recycle = run<LZW, PrepopulatedDictionary<256>, RecycleLeaves>(log, data, LeafRecycler::dictionary_limit(dict_size), repeat);
+        report(name + " lzw", "tree", data, lzw_tree, lzw_tree);
+        report(name + " lzw", "hash", data, lzw_hash, lzw_tree);
+        report(name + " lzw", "tree-huge", data, lzw_huge, lzw_tree);
+        report(name + " lzw", "packed", data, lzw_packed, lzw_tree);
+        report(name + " lzw", "adaptive", data, lzw_adaptive, lzw_adaptive);
+        report(name + " lzw", "recycle", data, lzw_recycle, lzw_recycle);
+
+        const size_t message = 64;
+        std::string stream_size;
+        std::string context_size;
+        double stream_cost = run_messages(data, message, repeat, stream_size, [&](const uchar_t *input, size_t size) {
+            std::istringstream stream{std::string{(const char *) input, size}};
+            std::ostringstream output;
+            {
+                LZW<Log &, PrepopulatedDictionary<256>, BitHuffOut> codec{log, PrepopulatedDictionary<256>{dict_size}, BitHuffOut{HuffOut{BitOut{output}}}};
+                codec.compress(BitIn{stream});
+            }
+
+            return output.str().size();
+        });
+
+        LZWContext context{bit_size};
+        std::vector<uchar_t> buffer(2 * message + 64);
+        double context_cost = run_messages(data, message, repeat, context_size, [&](const uchar_t *input, size_t size) {
+            return lzw_compress(context, input, size, buffer.data(), buffer.size());
+        });
+
+        report_messages(name + " lzw", "msg-stream", data, stream_size, stream_cost);
+        report_messages(name + " lzw", "msg-context", data, context_size, context_cost);
+
+        double stream_io = run_io(repeat, [&](void) {
+            std::ifstream input{argv[f], std::ifstream::in | std::ifstream::binary};
+            std::ofstream output{"/dev/null", std::ofstream::out | std::ofstream::binary};
+            return compress_file(log, dict_size, input, output);
+        });
+
+        double fd_io = run_io(repeat, [&](void) {
+            int input_descriptor = open(argv[f], O_RDONLY);
+            int output_descriptor = open("/dev/null", O_WRONLY);
+            double seconds = 0;
+            {
+                FdSource input{input_descriptor};
+                FdSink output{output_descriptor};
+                seconds = compress_file(log, dict_size, input, output);
+            }
+
+            close(input_descriptor);
+            close(output_descriptor);
+            return seconds;
+        });
+
+        report_io(name + " lzw", "io-stream", data, stream_io);
+        report_io(name + " lzw", "io-fd", data, fd_io);
+
+        Result lz78_tree = run<LZ78, Dictionary>(log, data, dict_size, repeat);
+        Result lz78_hash = run<LZ78, HashDictionary>(log, data, dict_size, repeat);
+        Result lz78_huge = run<LZ78, Dictionary>(log, data, dict_size, repeat, true);
+        Result lz78_packed = run<LZ78, PackedDictionary>(log, data, dict_size, repeat);
+        report(name + " lz78", "tree", data, lz78_tree, lz78_tree);
+        report(name + " lz78", "hash", data, lz78_hash, lz78_tree);
+        report(name + " lz78", "tree-huge", data, lz78_huge, lz78_tree);
+        report(name + " lz78", "packed", data, lz78_packed, lz78_tree);
+    }
+
+    return 0;
+}
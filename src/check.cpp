@@ -0,0 +1,177 @@
+/* 2015
+ * Maciej Szeptuch
+ */
+
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <codec.h>
+
+const char *VERSION = "0.1.0";
+const char *HELP    = "Usage: check [OPTION]...\n\
+Check the buffer to buffer codec API (codec.h) on generated messages: round\n\
+trips, outputs that do not fit and truncated or corrupted messages, all\n\
+through the same reused contexts. Exits with 1 on the first failure.\n\n\
+-b, --bitsize     dictionary bits (15-31, default=16)\n\
+-h, --help        give this help\n\
+-V, --version     display version number\n";
+const char *SHORT_OPTIONS = "b:hV";
+const struct option LONG_OPTIONS[] =
+{
+    {"bitsize",     required_argument,  nullptr, 'b'},
+    {"help",        no_argument,        nullptr, 'h'},
+    {"version",     no_argument,        nullptr, 'V'},
+    {nullptr, 0, nullptr, 0},
+};
+
+// Log-like lines, the same on every run
+std::string generate(size_t size, uint32_t seed)
+{
+    const char *words[] = {"GET", "POST", "/index.html", "/api/v1/items", "200", "404", "Mozilla/5.0", "curl/7.58", "-", "HTTP/1.1"};
+    std::string message;
+    while(message.size() < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        message += words[(seed >> 16) % 10];
+        message += (seed >> 8) % 7 ? ' ' : '\n';
+    }
+
+    message.resize(size);
+    return message;
+}
+
+template<typename CONTEXT>
+class Checker
+{
+    const char  *name;
+    CONTEXT     &context;
+    size_t      (*compress)(CONTEXT &, const uchar_t *, size_t, uchar_t *, size_t);
+    size_t      (*decompress)(CONTEXT &, const uchar_t *, size_t, uchar_t *, size_t);
+
+public:
+    Checker(const char *_name, CONTEXT &_context, decltype(compress) _compress, decltype(decompress) _decompress);
+
+    bool run(const std::string &message);
+
+private:
+    bool fail(const std::string &message, const std::string &what) const;
+}; // class Checker
+
+template<typename CONTEXT>
+inline
+Checker<CONTEXT>::Checker(const char *_name, CONTEXT &_context, decltype(compress) _compress, decltype(decompress) _decompress)
+:name{_name}
+,context(_context)
+,compress{_compress}
+,decompress{_decompress}
+{
+}
+
+template<typename CONTEXT>
+inline
+bool Checker<CONTEXT>::run(const std::string &message)
+{
+    const uchar_t *input = (const uchar_t *) message.data();
+    std::vector<uchar_t> packed(message.size() * 2 + 64);
+    std::vector<uchar_t> unpacked(message.size() + 1);
+
+    size_t size = compress(context, input, message.size(), packed.data(), packed.size());
+    if(size == CODEC_ERROR)
+        return fail(message, "compression failed");
+
+    size_t length = decompress(context, packed.data(), size, unpacked.data(), unpacked.size());
+    if(length != message.size() || !std::equal(begin(message), end(message), unpacked.data()))
+        return fail(message, "round trip differs");
+
+    if(size && compress(context, input, message.size(), packed.data(), size - 1) != CODEC_ERROR)
+        return fail(message, "compression into a too small buffer succeeded");
+
+    size = compress(context, input, message.size(), packed.data(), packed.size());
+    if(length && decompress(context, packed.data(), size, unpacked.data(), length - 1) != CODEC_ERROR)
+        return fail(message, "decompression into a too small buffer succeeded");
+
+    for(size_t cut: {size / 2, size - 1})
+        if(cut < size && decompress(context, packed.data(), cut, unpacked.data(), unpacked.size()) != CODEC_ERROR)
+            return fail(message, "truncated message decompressed into " + std::to_string(cut) + " of " + std::to_string(size) + " bytes");
+
+    // Without a checksum a flipped bit can still decode into another valid
+    // message (escaped bytes are stored as they are), it only must not
+    // write past the output. Ten flipped bytes must not go unnoticed.
+    std::vector<uchar_t> corrupt(packed.begin(), packed.begin() + size);
+    for(size_t position = 0; position < size; position += size / 64 + 1)
+    {
+        corrupt[position] ^= 0x10;
+        length = decompress(context, corrupt.data(), size, unpacked.data(), unpacked.size());
+        if(length != CODEC_ERROR && length > unpacked.size())
+            return fail(message, "message corrupted at byte " + std::to_string(position) + " overran the output");
+
+        corrupt[position] ^= 0x10;
+    }
+
+    if(size >= 10)
+    {
+        for(size_t flip = 0; flip < 10; ++ flip)
+            corrupt[flip * size / 10] ^= 0x5A;
+
+        if(decompress(context, corrupt.data(), size, unpacked.data(), unpacked.size()) != CODEC_ERROR)
+            return fail(message, "message with ten corrupted bytes decompressed");
+    }
+
+    // Failed calls leave nothing behind in the context
+    length = decompress(context, packed.data(), size, unpacked.data(), unpacked.size());
+    if(length != message.size() || !std::equal(begin(message), end(message), unpacked.data()))
+        return fail(message, "round trip after failed calls differs");
+
+    return true;
+}
+
+template<typename CONTEXT>
+inline
+bool Checker<CONTEXT>::fail(const std::string &message, const std::string &what) const
+{
+    std::cerr << name << ", " << message.size() << " byte message: " << what << "\n";
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t bit_size   = 16;
+
+    int o;
+    while((o = getopt_long(argc, argv, SHORT_OPTIONS, LONG_OPTIONS, 0)) != -1) switch(o)
+    {
+        case 'h': std::cout << HELP;
+            return 0;
+
+        case 'V': std::cout << "check " << VERSION << "\n";
+            return 0;
+
+        case 'b':
+            bit_size = atoi(optarg);
+            break;
+
+        case '?':
+        default: std::cerr << HELP;
+            return 1;
+    }
+
+    LZWContext lzw{bit_size};
+    LZ78Context lz78{bit_size};
+    Checker<LZWContext> lzw_checker{"lzw", lzw, lzw_compress, lzw_decompress};
+    Checker<LZ78Context> lz78_checker{"lz78", lz78, lz78_compress, lz78_decompress};
+
+    // Past 64KiB the codes no longer fit in one chunk of the readers
+    size_t count = 0;
+    for(size_t size: {0, 1, 2, 64, 1000, 5000, 100000})
+        for(uint32_t seed = 0; seed < 4; ++ seed, ++ count)
+        {
+            std::string message = generate(size, seed);
+            if(!lzw_checker.run(message) || !lz78_checker.run(message))
+                return 1;
+        }
+
+    std::cout << "codec checks passed on " << count << " messages\n";
+    return 0;
+}
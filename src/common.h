@@ -2,29 +2,53 @@
 #define __COMMON_H__
 
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <sys/stat.h>
 
 #include <bitstream.h>
+#include <bit_reader.h>
+#include <bit_writer.h>
 #include <adaptive_huffman.h>
+#include <vitter_huffman.h>
+#include <canonical_huffman.h>
+#include <header.h>
+#include <checksum.h>
+#include <stats.h>
+#include "log.h"
 
-typedef BitStream<std::ostream &>   BitOut;
-typedef BitStream<std::istream &>   BitIn;
+typedef BitWriter<std::ostream &>   BitOut;
+typedef BitReader<std::istream &>   BitIn;
 typedef AdaptiveHuffman<BitOut>     HuffOut;
 typedef AdaptiveHuffman<BitIn>      HuffIn;
-typedef BitStream<HuffOut>          BitHuffOut;
-typedef BitStream<HuffIn>           BitHuffIn;
+typedef BitWriter<HuffOut>          BitHuffOut;
+typedef BitReader<HuffIn>           BitHuffIn;
+typedef VitterHuffman<BitOut>       VitterOut;
+typedef VitterHuffman<BitIn>        VitterIn;
+typedef BitWriter<VitterOut>        BitVitterOut;
+typedef BitReader<VitterIn>         BitVitterIn;
+typedef CanonicalHuffman<BitOut>    CanonicalOut;
+typedef CanonicalHuffman<BitIn>     CanonicalIn;
+typedef BitWriter<CanonicalOut>     BitCanonicalOut;
+typedef BitReader<CanonicalIn>      BitCanonicalIn;
 
 template<>
 inline
-void BitHuffIn::flush(void)
+void HuffIn::flush(void)
 {
     // Nothing to flush when used for reading
 }
 
 template<>
 inline
-void BitIn::flush(void)
+void VitterIn::flush(void)
+{
+    // Nothing to flush when used for reading
+}
+
+template<>
+inline
+void CanonicalIn::flush(void)
 {
     // Nothing to flush when used for reading
 }
@@ -36,6 +60,42 @@ bool file_exists(const std::string &name)
     return (stat (name.c_str(), &buffer) == 0);
 }
 
+inline
+bool parse_coder(const std::string &name, Coder &coder)
+{
+    for(uint8_t c = 0; c < CODERS; ++ c)
+        if(name == CODER_NAME[c])
+        {
+            coder = (Coder) c;
+            return true;
+        }
+
+    return false;
+}
+
+// Compares trailer of the stream with what was actually decompressed
+inline
+bool verify_trailer(Log &log, TrailerBuffer &trailed, const ChecksumBuffer &checked)
+{
+    Trailer trailer;
+    if(!trailed.trailer(trailer))
+    {
+        log(Log::ERROR) << "Stream truncated, trailer missing";
+        return false;
+    }
+
+    if(trailer.length != checked.size() || trailer.checksum != checked.value())
+    {
+        log(Log::ERROR) << "Integrity check failed:"
+                        << " length=" << checked.size() << " expected=" << trailer.length
+                        << " checksum=" << checked.value() << " expected=" << trailer.checksum;
+        return false;
+    }
+
+    log(Log::INFO) << "Integrity check passed";
+    return true;
+}
+
 inline
 bool has_suffix(const std::string &str, const std::string &suffix)
 {
@@ -43,4 +103,42 @@ bool has_suffix(const std::string &str, const std::string &suffix)
             str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
 }
 
+// Counters of the whole run for --stats. Streams and blocks add theirs once
+// they are done, blocks do it from worker threads.
+inline
+Stats &run_stats(void)
+{
+    static Stats stats;
+    return stats;
+}
+
+inline
+std::mutex &run_stats_lock(void)
+{
+    static std::mutex lock;
+    return lock;
+}
+
+template<typename PART>
+inline
+void gather(const PART &part)
+{
+    std::lock_guard<std::mutex> guard{run_stats_lock()};
+    collect(run_stats(), part);
+}
+
+inline
+void gather_stage(const StageTimer &timer, const std::string &name)
+{
+    std::lock_guard<std::mutex> guard{run_stats_lock()};
+    timer.stop(run_stats(), name);
+}
+
+inline
+bool parse_stats(const char *format, bool &json)
+{
+    json = format && std::string(format) == "json";
+    return !format || json || std::string(format) == "text";
+}
+
 #endif // __COMMON_H__
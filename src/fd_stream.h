@@ -0,0 +1,283 @@
+#ifndef __FD_STREAM_H__
+#define __FD_STREAM_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <streambuf>
+#include <unistd.h>
+
+// Stream buffers straight over a file descriptor, used for standard input
+// and output. Data goes through one large page aligned buffer with plain
+// read(2)/write(2) calls, reads and writes larger than the buffer skip it.
+// Besides backing std::istream/std::ostream (headers, checksums and frames
+// are built on those), they have the read/gcount/good and write/flush/good
+// members BitReader, BitWriter and the entropy coders call, so they can be
+// the stream under them directly.
+class FdSource: public std::streambuf
+{
+    int     descriptor;
+    char    *buffer;
+    size_t  capacity;
+    size_t  last_count;
+    bool    eof;
+
+public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    FdSource(int _descriptor, size_t _capacity=BUFFER_SIZE);
+    ~FdSource(void);
+
+    FdSource(const FdSource &) = delete;
+    FdSource &operator=(const FdSource &) = delete;
+
+    bool good(void) const;
+    void read(char *data, size_t bytes);
+    size_t gcount(void) const;
+
+protected:
+    int_type underflow(void) override;
+    std::streamsize xsgetn(char *data, std::streamsize bytes) override;
+
+private:
+    size_t receive(char *data, size_t bytes);
+}; // class FdSource
+
+class FdSink: public std::streambuf
+{
+    int     descriptor;
+    char    *buffer;
+    size_t  capacity;
+    bool    failed;
+
+public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    FdSink(int _descriptor, size_t _capacity=BUFFER_SIZE);
+    ~FdSink(void);
+
+    FdSink(const FdSink &) = delete;
+    FdSink &operator=(const FdSink &) = delete;
+
+    bool good(void) const;
+    void write(const char *data, size_t bytes);
+    void flush(void);
+
+protected:
+    int_type overflow(int_type character) override;
+    std::streamsize xsputn(const char *data, std::streamsize bytes) override;
+    int sync(void) override;
+
+private:
+    bool send(const char *data, size_t bytes);
+}; // class FdSink
+
+inline
+char *allocate_page_aligned(size_t size)
+{
+    void *memory = nullptr;
+    if(posix_memalign(&memory, sysconf(_SC_PAGESIZE), size))
+        throw std::bad_alloc();
+
+    return (char *) memory;
+}
+
+// Input is read front to back once, so the kernel may read ahead further
+// (pipes and terminals ignore it)
+inline
+FdSource::FdSource(int _descriptor, size_t _capacity)
+:descriptor{_descriptor}
+,buffer{allocate_page_aligned(_capacity)}
+,capacity{_capacity}
+,last_count{0}
+,eof{false}
+{
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    setg(buffer, buffer, buffer);
+}
+
+inline
+FdSource::~FdSource(void)
+{
+    free(buffer);
+}
+
+inline
+bool FdSource::good(void) const
+{
+    return !eof;
+}
+
+// Ends like std::istream: a read that comes up short marks the end of input
+inline
+void FdSource::read(char *data, size_t bytes)
+{
+    last_count = sgetn(data, bytes);
+    eof = last_count < bytes;
+}
+
+inline
+size_t FdSource::gcount(void) const
+{
+    return last_count;
+}
+
+inline
+FdSource::int_type FdSource::underflow(void)
+{
+    if(gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    ssize_t count;
+    do
+        count = ::read(descriptor, buffer, capacity);
+    while(count < 0 && errno == EINTR);
+
+    if(count <= 0)
+        return traits_type::eof();
+
+    setg(buffer, buffer, buffer + count);
+    return traits_type::to_int_type(*gptr());
+}
+
+inline
+std::streamsize FdSource::xsgetn(char *data, std::streamsize bytes)
+{
+    std::streamsize done = 0;
+    while(done < bytes)
+    {
+        std::streamsize buffered = std::min<std::streamsize>(bytes - done, egptr() - gptr());
+        memcpy(data + done, gptr(), buffered);
+        gbump(buffered);
+        done += buffered;
+        if(bytes - done >= (std::streamsize) capacity)
+            return done + receive(data + done, bytes - done);
+
+        if(done < bytes && underflow() == traits_type::eof())
+            break;
+    }
+
+    return done;
+}
+
+// Reads until bytes are there or the input ends, pipes give less at a time
+inline
+size_t FdSource::receive(char *data, size_t bytes)
+{
+    size_t done = 0;
+    while(done < bytes)
+    {
+        ssize_t count = ::read(descriptor, data + done, bytes - done);
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count <= 0)
+            break;
+
+        done += count;
+    }
+
+    return done;
+}
+
+inline
+FdSink::FdSink(int _descriptor, size_t _capacity)
+:descriptor{_descriptor}
+,buffer{allocate_page_aligned(_capacity)}
+,capacity{_capacity}
+,failed{false}
+{
+    setp(buffer, buffer + capacity);
+}
+
+inline
+FdSink::~FdSink(void)
+{
+    sync();
+    free(buffer);
+}
+
+inline
+bool FdSink::good(void) const
+{
+    return !failed;
+}
+
+inline
+void FdSink::write(const char *data, size_t bytes)
+{
+    if(sputn(data, bytes) < (std::streamsize) bytes)
+        failed = true;
+}
+
+inline
+void FdSink::flush(void)
+{
+    if(pubsync())
+        failed = true;
+}
+
+inline
+FdSink::int_type FdSink::overflow(int_type character)
+{
+    if(sync())
+        return traits_type::eof();
+
+    if(!traits_type::eq_int_type(character, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(character);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(character);
+}
+
+inline
+std::streamsize FdSink::xsputn(const char *data, std::streamsize bytes)
+{
+    if(bytes > epptr() - pptr())
+    {
+        if(sync())
+            return 0;
+
+        if(bytes >= (std::streamsize) capacity)
+            return send(data, bytes) ? bytes : 0;
+    }
+
+    memcpy(pptr(), data, bytes);
+    pbump(bytes);
+    return bytes;
+}
+
+inline
+int FdSink::sync(void)
+{
+    bool sent = send(pbase(), pptr() - pbase());
+    setp(buffer, buffer + capacity);
+    failed = failed || !sent;
+    return sent ? 0 : -1;
+}
+
+inline
+bool FdSink::send(const char *data, size_t bytes)
+{
+    while(bytes)
+    {
+        ssize_t count = ::write(descriptor, data, bytes);
+        if(count < 0 && errno == EINTR)
+            continue;
+
+        if(count <= 0)
+            return false;
+
+        data += count;
+        bytes -= count;
+    }
+
+    return true;
+}
+
+#endif // __FD_STREAM_H__
@@ -0,0 +1,225 @@
+#ifndef __FRAMING_H__
+#define __FRAMING_H__
+
+#include <deque>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <entropy.h>
+#include <header.h>
+#include <worker_pool.h>
+#include "log.h"
+#include "common.h"
+
+// Blocks with more bits per byte (order-0) are not worth running LZ on,
+// already compressed data is close to 8
+const double STORE_ENTROPY = 7.9;
+
+// LZ codes with more bits per byte are not worth entropy coding, the coder
+// would save next to nothing (or make them bigger)
+const double UNCODED_ENTROPY = 7.95;
+
+// Compressed block and the frame type it goes out as
+struct FrameData
+{
+    Frame::Type type;
+    std::string data;
+}; // struct FrameData
+
+// Runs LZ codes through the entropy coder, the result is the same as if
+// they were written into it directly. primer only applies to FGK.
+inline
+std::string entropy_code(Coder coder, std::string &codes, const uint16_t *primer=nullptr)
+{
+    std::ostringstream output;
+    switch(coder)
+    {
+        case VITTER:
+            BitVitterOut{VitterOut{BitOut{output}}}.write(&codes[0], codes.size());
+            break;
+
+        case CANONICAL:
+            BitCanonicalOut{CanonicalOut{BitOut{output}, CanonicalOut::BLOCK_SIZE}}.write(&codes[0], codes.size());
+            break;
+
+        default:
+        {
+            BitHuffOut coded{HuffOut{BitOut{output}, primer}};
+            coded.write(&codes[0], codes.size());
+            gather(coded);
+            break;
+        }
+    }
+
+    return output.str();
+}
+
+// Picks the cheapest frame for a block. Blocks that look random are stored
+// without trying LZ, LZ codes that look random skip the entropy coder, and
+// whatever did not shrink after all is stored or left uncoded.
+// compress_codes turns a block into bare LZ codes.
+template<typename COMPRESS>
+FrameData pack_block(const std::string &block, Coder coder, COMPRESS compress_codes, const uint16_t *primer=nullptr)
+{
+    if(order0_entropy((const uchar_t *) block.data(), block.size()) > STORE_ENTROPY)
+        return {Frame::STORED, block};
+
+    std::string codes = compress_codes(block);
+    if(codes.size() >= block.size())
+        return {Frame::STORED, block};
+
+    if(order0_entropy((const uchar_t *) codes.data(), codes.size()) > UNCODED_ENTROPY)
+        return {Frame::UNCODED, std::move(codes)};
+
+    std::string coded = entropy_code(coder, codes, primer);
+    if(coded.size() >= codes.size())
+        return {Frame::UNCODED, std::move(codes)};
+
+    return {Frame::CODED, std::move(coded)};
+}
+
+// Compresses input in independent blocks of block_size bytes on a pool of
+// threads. Frames are written in input order; at most two blocks per thread
+// wait for their turn, which bounds memory use. compress_block decides how
+// each block is stored.
+template<typename COMPRESS>
+bool compress_framed(Log &log, std::istream &input, std::ostream &output, bool test, size_t block_size, size_t threads, COMPRESS compress_block)
+{
+    struct Pending
+    {
+        uint32_t                length;
+        std::future<FrameData>  block;
+    }; // struct Pending
+
+    WorkerPool pool{threads};
+    std::deque<Pending> pending;
+    uint64_t compressed = 0;
+    uint64_t uncompressed = 0;
+    size_t blocks = 0;
+    size_t stored = 0;
+    size_t uncoded = 0;
+
+    auto write_frame = [&](void) {
+        Pending &front = pending.front();
+        FrameData block = front.block.get();
+        if(!test)
+        {
+            Frame{(uint32_t) block.data.size(), front.length, block.type}.write(output);
+            output.write(block.data.data(), block.data.size());
+        }
+
+        compressed += Frame::SIZE + block.data.size();
+        uncompressed += front.length;
+        ++ blocks;
+        stored += block.type == Frame::STORED;
+        uncoded += block.type == Frame::UNCODED;
+        pending.pop_front();
+    };
+
+    log(log.INFO) << "Starting compression in blocks of " << block_size << " bytes on " << threads << " threads...";
+    while(input)
+    {
+        std::string block(block_size, '\0');
+        input.read(&block[0], block_size);
+        block.resize(input.gcount());
+        if(block.empty())
+            break;
+
+        uint32_t length = block.size();
+        pending.push_back({length, pool.submit([block = std::move(block), &compress_block] {
+            return compress_block(block);
+        })});
+
+        if(pending.size() > 2 * threads)
+            write_frame();
+    }
+
+    while(!pending.empty())
+        write_frame();
+
+    if(!test)
+        Frame{}.write(output);
+
+    log(log.INFO) << "Compressed " << uncompressed << " bytes into " << compressed + Frame::SIZE
+                  << " bytes of frames (" << blocks << " blocks, " << stored << " stored, "
+                  << uncoded << " without entropy coding)";
+    return output.good() || test;
+}
+
+// Decompresses frames on a pool of threads and writes them back in order.
+// As with compression, at most two frames per thread are held in memory.
+// Stored frames are passed through, decompress_block gets the others along
+// with their type.
+template<typename DECOMPRESS>
+bool decompress_framed(Log &log, std::istream &input, std::ostream &output, size_t threads, DECOMPRESS decompress_block)
+{
+    struct Pending
+    {
+        uint32_t                    length;
+        std::future<std::string>    data;
+    }; // struct Pending
+
+    WorkerPool pool{threads};
+    std::deque<Pending> pending;
+
+    auto write_frame = [&](void) {
+        Pending &front = pending.front();
+        std::string data = front.data.get();
+        uint32_t length = front.length;
+        pending.pop_front();
+        if(data.size() != length)
+        {
+            log(log.ERROR) << "Frame decompressed into " << data.size() << " bytes, expected " << length;
+            return false;
+        }
+
+        output.write(data.data(), data.size());
+        return true;
+    };
+
+    log(log.INFO) << "Starting decompression of frames on " << threads << " threads...";
+    Frame frame;
+    while(true)
+    {
+        if(!frame.read(input))
+        {
+            log(log.ERROR) << "Stream truncated or corrupted, invalid frame";
+            return false;
+        }
+
+        if(!frame.size)
+            break;
+
+        std::string data(frame.size, '\0');
+        if(!input.read(&data[0], frame.size))
+        {
+            log(log.ERROR) << "Stream truncated inside a frame";
+            return false;
+        }
+
+        if(frame.type == Frame::STORED)
+        {
+            std::promise<std::string> stored;
+            stored.set_value(std::move(data));
+            pending.push_back({frame.length, stored.get_future()});
+        }
+
+        else
+            pending.push_back({frame.length, pool.submit([type = frame.type, data = std::move(data), &decompress_block] {
+                return decompress_block(type, data);
+            })});
+
+        if(pending.size() > 2 * threads && !write_frame())
+            return false;
+    }
+
+    while(!pending.empty())
+        if(!write_frame())
+            return false;
+
+    return output.good();
+}
+
+#endif // __FRAMING_H__
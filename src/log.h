@@ -3,6 +3,16 @@
 
 #include <iostream>
 
+// Lines below LOG_MIN_LEVEL are compiled out. Release builds (NDEBUG) keep
+// INFO and above, DEBUG tracing is only in debug builds.
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL INFO
+#else
+#define LOG_MIN_LEVEL DEBUG
+#endif
+#endif
+
 class Log
 {
     std::ostream &stream;
@@ -17,6 +27,7 @@ public:
         LOG_LEVELS
     }; // enum LOG_LEVEL
 
+    static const LOG_LEVEL MIN_LEVEL = LOG_MIN_LEVEL;
     static const char *LEVEL_NAME[8];
 
     class Log_line
@@ -41,6 +52,7 @@ public:
 
     void disable(void);
     void verbose(void);
+    bool enabled(LOG_LEVEL level) const;
 
     Log_line operator()(LOG_LEVEL level);
 
@@ -76,6 +88,13 @@ void Log::verbose(void)
     level = DEBUG;
 }
 
+// Lets hot paths skip evaluating arguments of lines that would be dropped
+inline
+bool Log::enabled(Log::LOG_LEVEL _level) const
+{
+    return _level >= MIN_LEVEL && _level >= level;
+}
+
 inline
 Log::Log_line Log::operator()(Log::LOG_LEVEL _level)
 {
@@ -95,20 +114,20 @@ Log::Log_line::Log_line(std::ostream &_stream, LOG_LEVEL _level, LOG_LEVEL _line
 ,level(_level)
 ,line_level(_line_level)
 {
-    if(line_level >= level)
+    if(line_level >= MIN_LEVEL && line_level >= level)
         stream << Log::LEVEL_NAME[_line_level] << ": ";
 }
 
 Log::Log_line::~Log_line(void)
 {
-    if(line_level >= level)
+    if(line_level >= MIN_LEVEL && line_level >= level)
         stream << "\n";
 }
 
 template<typename TYPE>
 typename Log::Log_line::Log_line &Log::Log_line::operator<<(TYPE variable)
 {
-    if(line_level >= level)
+    if(line_level >= MIN_LEVEL && line_level >= level)
         stream << variable;
 
     return *this;
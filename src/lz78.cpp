@@ -5,58 +5,189 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include <lz78/lz78.h>
 #include <bitstream.h>
 #include <dictionary.h>
+#include <decoding_dictionary.h>
 #include <adaptive_huffman.h>
 #include "log.h"
 #include "common.h"
+#include "framing.h"
+#include "fd_stream.h"
+#include "mapped_file.h"
 
 const char *VERSION = "0.1.0";
 const char *HELP    = "Usage: lz78 [OPTION]... [FILE]\n\
 Compress or uncompress FILE.\n\n\
 -c, --stdout      write on standard output\n\
 -b, --bitsize     dictionary bits (15-31, default=20)\n\
+-B, --block-size  block size in MiB (0-1023, default=4, 0=single stream)\n\
 -d, --decompress  decompress\n\
+-e, --entropy     entropy coder (fgk, vitter, canonical, default=fgk)\n\
 -f, --force       force overwrite of output file\n\
 -h, --help        give this help\n\
+-H, --huge-pages  keep the compression dictionary on huge pages\n\
+-p, --threads     (de)compress blocks on N threads (0=all cores, default=1, all to decompress)\n\
 -q, --quiet       suppress all warnings\n\
+    --stats[=json] print counters and stage times when done (text or json)\n\
+                  (only the whole run and the blocks are timed)\n\
 -t, --test        test compressed file integrity\n\
 -v, --verbose     verbose mode\n\
 -V, --version     display version number\n\n\
 With no FILE, or when FILE is -, read standard input.\n";
-const char *SHORT_OPTIONS = "cb:dfhqtvV";
+const char *SHORT_OPTIONS = "cb:B:de:fhHp:qtvV";
 const struct option LONG_OPTIONS[] =
 {
     {"stdout",      no_argument,        nullptr, 'c'},
     {"bitsize",     required_argument,  nullptr, 'b'},
+    {"block-size",  required_argument,  nullptr, 'B'},
     {"decompress",  no_argument,        nullptr, 'd'},
+    {"entropy",     required_argument,  nullptr, 'e'},
     {"force",       no_argument,        nullptr, 'f'},
     {"help",        no_argument,        nullptr, 'h'},
+    {"huge-pages",  no_argument,        nullptr, 'H'},
+    {"threads",     required_argument,  nullptr, 'p'},
     {"quiet",       no_argument,        nullptr, 'q'},
+    {"stats",       optional_argument,  nullptr, 'S'},
     {"test",        no_argument,        nullptr, 't'},
     {"verbose",     no_argument,        nullptr, 'v'},
     {"version",     no_argument,        nullptr, 'V'},
     {nullptr, 0, nullptr, 0},
 };
 
+template<typename OUTPUT>
+bool compress_stream(Log &log, size_t dict_size, bool huge_pages, bool test, std::istream &input, OUTPUT output)
+{
+    // Output is kept out here to count what the entropy coder did with the
+    // codes left buffered until the end
+    LZ78<Log &, Dictionary, OUTPUT &> lz78{log, Dictionary{dict_size, huge_pages}, output};
+    if(test)
+        lz78.simulate();
+
+    BitIn bitstream{input};
+    log(log.INFO) << "Starting compression...";
+    lz78.compress(bitstream);
+    lz78.flush();
+    output.flush();
+    gather(lz78);
+    return lz78.good();
+}
+
+template<typename INPUT>
+bool decompress_stream(Log &log, size_t dict_size, std::ostream &output, INPUT input)
+{
+    LZ78<Log &, DecodingDictionary, BitOut> lz78{log, DecodingDictionary{dict_size}, BitOut{output}};
+    log(log.INFO) << "Starting decompression...";
+    lz78.template decompress<INPUT &>(input);
+    gather(lz78);
+    gather(input);
+    return lz78.good();
+}
+
+bool compress_with(Log &log, size_t dict_size, bool huge_pages, bool test, Coder coder, std::istream &input, std::ostream &output)
+{
+    switch(coder)
+    {
+        case VITTER:
+            return compress_stream(log, dict_size, huge_pages, test, input, BitVitterOut{VitterOut{BitOut{output}}});
+
+        case CANONICAL:
+            return compress_stream(log, dict_size, huge_pages, test, input, BitCanonicalOut{CanonicalOut{BitOut{output}, CanonicalOut::BLOCK_SIZE}});
+
+        default:
+            return compress_stream(log, dict_size, huge_pages, test, input, BitHuffOut{HuffOut{BitOut{output}}});
+    }
+}
+
+bool decompress_with(Log &log, size_t dict_size, const Header &header, std::istream &input, std::ostream &output)
+{
+    switch(header.coder)
+    {
+        case VITTER:
+            return decompress_stream(log, dict_size, output, BitVitterIn{VitterIn{BitIn{input}}});
+
+        case CANONICAL:
+            return decompress_stream(log, dict_size, output, BitCanonicalIn{CanonicalIn{BitIn{input}, header.block_size ? header.block_size : CanonicalIn::BLOCK_SIZE}});
+
+        default:
+            return decompress_stream(log, dict_size, output, BitHuffIn{HuffIn{BitIn{input}}});
+    }
+}
+
+// Blocks are compressed by worker threads, each with its own silent log
+FrameData compress_block(size_t dict_size, bool huge_pages, Coder coder, const std::string &block)
+{
+    StageTimer timer;
+    FrameData frame = pack_block(block, coder, [&](const std::string &data) {
+        Log log;
+        log.disable();
+
+        std::istringstream input{data};
+        std::ostringstream output;
+        if(!compress_stream(log, dict_size, huge_pages, false, input, BitOut{output}))
+            throw std::runtime_error("Block compression failed");
+
+        return output.str();
+    });
+
+    gather_stage(timer, "blocks");
+    return frame;
+}
+
+std::string decompress_block(size_t dict_size, const Header &header, Frame::Type type, const std::string &block)
+{
+    StageTimer timer;
+    Log log;
+    log.disable();
+
+    std::istringstream input{block};
+    std::ostringstream output;
+    bool good = type == Frame::UNCODED
+        ? decompress_stream(log, dict_size, output, BitIn{input})
+        : decompress_with(log, dict_size, header, input, output);
+
+    if(!good)
+        throw std::runtime_error("Corrupted frame");
+
+    gather_stage(timer, "blocks");
+    return output.str();
+}
+
 int main(int argc, char **argv)
 {
     std::string file    = "";
+    std::string output_name = "";
     bool compress       = true;
     bool file_output    = true;
+    bool huge_pages     = false;
     bool overwrite      = false;
     bool quiet          = false;
+    bool stats          = false;
+    bool stats_json     = false;
     bool test           = false;
     bool verbose        = false;
     uint32_t bit_size   = 20;
+    uint32_t block_size = 4;
+    int threads         = -1;
+    Coder coder         = FGK;
 
     std::ifstream input_file;
     std::ofstream output_file;
+    MappedFile input_map;
+    MappedFile output_map;
+    std::istream mapped_input{&input_map};
+    std::ostream mapped_output{&output_map};
 
-    std::istream *input     = &std::cin;
-    std::ostream *output    = &std::cout;
+    FdSource standard_input{STDIN_FILENO};
+    FdSink standard_output{STDOUT_FILENO};
+    std::istream fd_input{&standard_input};
+    std::ostream fd_output{&standard_output};
+
+    std::istream *input     = &fd_input;
+    std::ostream *output    = &fd_output;
 
     Log log{std::cerr};
 
@@ -81,14 +212,37 @@ int main(int argc, char **argv)
             compress = false;
             break;
 
+        case 'e':
+            if(!parse_coder(optarg, coder))
+            {
+                std::cerr << HELP;
+                return 1;
+            }
+
+            break;
+
         case 'f':
             overwrite = true;
             break;
 
+        case 'H':
+            huge_pages = true;
+            break;
+
         case 'q':
             quiet = true;
             break;
 
+        case 'S':
+            if(!parse_stats(optarg, stats_json))
+            {
+                std::cerr << HELP;
+                return 1;
+            }
+
+            stats = true;
+            break;
+
         case 'v':
             verbose = true;
             break;
@@ -97,6 +251,14 @@ int main(int argc, char **argv)
             bit_size = atoi(optarg);
             break;
 
+        case 'B':
+            block_size = atoi(optarg);
+            break;
+
+        case 'p':
+            threads = atoi(optarg);
+            break;
+
         case '?':
         default: std::cerr << HELP;
             return 1;
@@ -114,8 +276,12 @@ int main(int argc, char **argv)
     log(Log::DEBUG) << "running with options:"
                     << " stdout="       << !file_output
                     << " bitsize="      << bit_size
+                    << " blocksize="    << block_size
                     << " decompress="   << !compress
+                    << " entropy="      << CODER_NAME[coder]
                     << " force="        << overwrite
+                    << " hugepages="    << huge_pages
+                    << " threads="      << threads
                     << " quiet="        << quiet
                     << " test="         << test
                     << " verbose="      << verbose
@@ -124,13 +290,30 @@ int main(int argc, char **argv)
     if(bit_size < 15 || bit_size > 31)
         throw std::runtime_error("Invalid bit_size for dictionary");
 
+    if(block_size > Frame::MAX_SIZE >> 20)
+        throw std::runtime_error("Invalid block_size");
+
+    // Framed streams are always decompressed in parallel
+    if(threads < 0 && compress)
+        threads = 1;
+
+    if(threads <= 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
     if(!file.empty())
     {
         if(!file_exists(file))
             throw std::runtime_error("Input file doesn't exist");
 
-        input_file.open(file, std::ifstream::in | std::ifstream::binary);
-        input = &input_file;
+        // Regular files are read straight from their mapping
+        if(input_map.open(file))
+            input = &mapped_input;
+
+        else
+        {
+            input_file.open(file, std::ifstream::in | std::ifstream::binary);
+            input = &input_file;
+        }
     }
 
     if(file_output && !file.empty() && !test)
@@ -149,36 +332,137 @@ int main(int argc, char **argv)
         if(!overwrite && file_exists(file))
             throw std::runtime_error("Output file already exists");
 
-        output_file.open(file, std::ofstream::out | std::ofstream::binary);
-        output = &output_file;
+        output_name = file;
     }
 
+    StageTimer timer{true};
+    int status = 0;
     size_t dict_size = 1U << bit_size;
     if(compress)
     {
-        //LZ78<Log &, Dictionary, BitOut> lz78{log, Dictionary{dict_size}, BitOut{*output}};
-        LZ78<Log &, Dictionary, BitHuffOut> lz78{log, Dictionary{dict_size}, BitHuffOut{HuffOut{BitOut{*output}}}};
-        if(test)
-            lz78.simulate();
-
-        BitIn bitstream{*input};
-        log(log.INFO) << "Starting compression...";
-        lz78.compress(bitstream);
-        return !lz78.good();
+        Header header{ALGORITHM_LZ78, (uint8_t) bit_size, coder, coder == CANONICAL ? CanonicalOut::BLOCK_SIZE : 0};
+        if(block_size)
+            header.flags |= Header::FLAG_FRAMED;
+
+        if(!output_name.empty())
+        {
+            output_file.open(output_name, std::ofstream::out | std::ofstream::binary);
+            output = &output_file;
+        }
+
+        // Only counted for --stats
+        ChecksumBuffer counted{output->rdbuf()};
+        std::ostream counted_output{&counted};
+        if(stats)
+            output = &counted_output;
+
+        if(!test)
+            header.write(*output);
+
+        // Trailer describes the data actually read from the input
+        ChecksumBuffer checked{input->rdbuf()};
+        std::istream checked_input{&checked};
+        bool good = false;
+        if(header.flags & Header::FLAG_FRAMED)
+            good = compress_framed(log, checked_input, *output, test, (size_t) block_size << 20, threads, [&](const std::string &block) {
+                return compress_block(dict_size, huge_pages, coder, block);
+            });
+
+        else
+            good = compress_with(log, dict_size, huge_pages, test, coder, checked_input, *output);
+
+        if(!test)
+            Trailer{checked.size(), checked.value()}.write(*output);
+
+        output->flush();
+        run_stats().bytes_in = checked.size();
+        run_stats().bytes_out = counted.size();
+        status = !good;
     }
 
     else
     {
-        LZ78<Log &, Dictionary, BitOut> lz78{log, Dictionary{dict_size}, BitOut{*output}};
-        if(test)
-            lz78.simulate();
-
-        //BitIn bitstream{*input};
-        BitHuffIn bitstream{HuffIn{BitIn{*input}}};
-        log(log.INFO) << "Starting decompression...";
-        lz78.decompress(bitstream);
-        return !lz78.good();
+        // Only counted for --stats
+        ChecksumBuffer counted{input->rdbuf()};
+        std::istream counted_input{&counted};
+        if(stats)
+            input = &counted_input;
+
+        Header header;
+        if(!header.read(*input))
+            throw std::runtime_error("Invalid stream header");
+
+        log(Log::DEBUG) << "stream header: version=" << (int) header.version
+                        << " algorithm="    << ALGORITHM_NAME[header.algorithm]
+                        << " bitsize="      << (int) header.bit_size
+                        << " entropy="      << CODER_NAME[header.coder]
+                        << " block_size="   << header.block_size
+                        << " flags="        << (int) header.flags;
+
+        if(header.has_trailer())
+        {
+            if(header.algorithm != ALGORITHM_LZ78)
+                throw std::runtime_error("Stream not compressed with lz78");
+
+            if(header.bit_size < 15 || header.bit_size > 31)
+                throw std::runtime_error("Invalid bit_size for dictionary");
+
+            dict_size = 1U << header.bit_size;
+        }
+
+        // Trailer at the end of a mapped input gives the expected size of the
+        // output, so it can be mapped too. It is only a hint for how much to
+        // reserve up front, the mapping grows if the output turns out longer.
+        if(!output_name.empty())
+        {
+            Trailer trailer;
+            if(header.has_trailer() && input_map.size() >= Trailer::SIZE)
+                trailer.read(input_map.begin() + input_map.size() - Trailer::SIZE);
+
+            size_t reserved = std::min<uint64_t>(trailer.length, input_map.size() * MappedFile::MAX_EXPANSION);
+            if(reserved && output_map.create(output_name, reserved))
+                output = &mapped_output;
+
+            else
+            {
+                output_file.open(output_name, std::ofstream::out | std::ofstream::binary);
+                output = &output_file;
+            }
+        }
+
+        // Output is only checksummed when testing integrity
+        TrailerBuffer trailed{input->rdbuf()};
+        ChecksumBuffer checked{test ? nullptr : output->rdbuf()};
+        std::istream body{header.has_trailer() ? &trailed : input->rdbuf()};
+        std::ostream checked_output{&checked};
+        bool good = false;
+        if(header.flags & Header::FLAG_FRAMED)
+            good = decompress_framed(log, body, checked_output, threads, [&](Frame::Type type, const std::string &block) {
+                return decompress_block(dict_size, header, type, block);
+            });
+
+        else
+            good = decompress_with(log, dict_size, header, body, checked_output);
+
+        checked_output.flush();
+        run_stats().bytes_in = counted.size();
+        run_stats().bytes_out = checked.size();
+        if(!good)
+            status = 1;
+
+        else if(header.has_trailer())
+            status = !verify_trailer(log, trailed, checked);
+    }
+
+    if(stats)
+    {
+        timer.stop(run_stats(), "total");
+        if(stats_json)
+            run_stats().write_json(std::cerr);
+
+        else
+            run_stats().write(std::cerr);
     }
 
-    return 0;
+    return status;
 }
@@ -5,58 +5,390 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include <lzw/lzw.h>
 #include <bitstream.h>
 #include <dictionary.h>
+#include <decoding_dictionary.h>
 #include <adaptive_huffman.h>
+#include <batch_ring.h>
+#include <preset.h>
 #include "log.h"
 #include "common.h"
+#include "framing.h"
+#include "fd_stream.h"
+#include "mapped_file.h"
 
 const char *VERSION = "0.1.0";
 const char *HELP    = "Usage: lzw [OPTION]... [FILE]\n\
 Compress or uncompress FILE.\n\n\
+-A, --adaptive-reset clear a full dictionary only once it stops compressing well\n\
 -c, --stdout      write on standard output\n\
 -b, --bitsize     dictionary bits (15-31, default=20)\n\
+-B, --block-size  block size in MiB (0-1023, default=4, 0=single stream)\n\
 -d, --decompress  decompress\n\
+-D, --dictionary  start from preset dictionary FILE (made by train)\n\
+-e, --entropy     entropy coder (fgk, vitter, canonical, default=fgk)\n\
 -f, --force       force overwrite of output file\n\
 -h, --help        give this help\n\
+-H, --huge-pages  keep the compression dictionary on huge pages\n\
+-p, --threads     (de)compress blocks on N threads (0=all cores, default=1, all to decompress)\n\
+-P, --pipeline    run the stages of a single stream (-B 0) on separate threads\n\
 -q, --quiet       suppress all warnings\n\
+-R, --recycle     reuse least recently used dictionary entries instead of clearing\n\
+    --stats[=json] print counters and stage times when done (text or json)\n\
+                  (a stream is split into read/parse/code stages only with -P)\n\
 -t, --test        test compressed file integrity\n\
 -v, --verbose     verbose mode\n\
 -V, --version     display version number\n\n\
 With no FILE, or when FILE is -, read standard input.\n";
-const char *SHORT_OPTIONS = "cb:dfhqtvV";
+const char *SHORT_OPTIONS = "Acb:B:dD:e:fhHp:PqRtvV";
 const struct option LONG_OPTIONS[] =
 {
+    {"adaptive-reset", no_argument,     nullptr, 'A'},
     {"stdout",      no_argument,        nullptr, 'c'},
     {"bitsize",     required_argument,  nullptr, 'b'},
+    {"block-size",  required_argument,  nullptr, 'B'},
     {"decompress",  no_argument,        nullptr, 'd'},
+    {"dictionary",  required_argument,  nullptr, 'D'},
+    {"entropy",     required_argument,  nullptr, 'e'},
     {"force",       no_argument,        nullptr, 'f'},
     {"help",        no_argument,        nullptr, 'h'},
+    {"huge-pages",  no_argument,        nullptr, 'H'},
+    {"threads",     required_argument,  nullptr, 'p'},
+    {"pipeline",    no_argument,        nullptr, 'P'},
     {"quiet",       no_argument,        nullptr, 'q'},
+    {"recycle",     no_argument,        nullptr, 'R'},
+    {"stats",       optional_argument,  nullptr, 'S'},
     {"test",        no_argument,        nullptr, 't'},
     {"verbose",     no_argument,        nullptr, 'v'},
     {"version",     no_argument,        nullptr, 'V'},
     {nullptr, 0, nullptr, 0},
 };
 
+// Full dictionary policy from the header flags
+template<typename CODEC>
+void set_policy(CODEC &lzw, uint8_t flags)
+{
+    if(flags & Header::FLAG_RECYCLE)
+        lzw.recycle_leaves();
+
+    else if(flags & Header::FLAG_ADAPTIVE_RESET)
+        lzw.adaptive_reset();
+}
+
+// Recycling keeps its recency list within the same memory, so the
+// dictionary itself gets fewer elements
+size_t dictionary_limit(size_t dict_size, uint8_t flags)
+{
+    return flags & Header::FLAG_RECYCLE ? LeafRecycler::dictionary_limit(dict_size) : dict_size;
+}
+
+// FGK tree starts primed by the preset, other coders ignore it
+const uint16_t *primer(const Preset *preset)
+{
+    return preset ? preset->counts.data() : nullptr;
+}
+
+template<typename INPUT, typename OUTPUT>
+bool compress_stream(Log &log, size_t dict_size, const Preset *preset, uint8_t flags, bool huge_pages, bool test, INPUT input, OUTPUT output)
+{
+    // Output is kept out here to count what the entropy coder did with the
+    // codes left buffered until the end
+    LZW<Log &, PresetDictionary<>, OUTPUT &> lzw{log, PresetDictionary<>{preset, dictionary_limit(dict_size, flags), huge_pages}, output};
+    set_policy(lzw, flags);
+    if(test)
+        lzw.simulate();
+
+    log(log.INFO) << "Starting compression...";
+    lzw.compress(input);
+    lzw.flush();
+    output.flush();
+    gather(lzw);
+    return lzw.good();
+}
+
+template<typename OUTPUT, typename INPUT>
+bool decompress_stream(Log &log, size_t dict_size, const Preset *preset, uint8_t flags, OUTPUT output, INPUT input)
+{
+    // When the encoder clears its dictionary as soon as it fills, the
+    // decoder, one element behind, has to clear one element earlier
+    typedef PresetDictionary<DecodingDictionary> Decoding;
+    bool keeps_full = flags & (Header::FLAG_ADAPTIVE_RESET | Header::FLAG_RECYCLE);
+    LZW<Log &, Decoding, OUTPUT> lzw{log, Decoding{preset, keeps_full ? dictionary_limit(dict_size, flags) : dict_size - sizeof(Element)}, output};
+    set_policy(lzw, flags);
+    log(log.INFO) << "Starting decompression...";
+    lzw.template decompress<INPUT &>(input);
+    gather(lzw);
+    gather(input);
+    return lzw.good();
+}
+
+bool compress_with(Log &log, size_t dict_size, const Preset *preset, uint8_t flags, bool huge_pages, bool test, Coder coder, std::istream &input, std::ostream &output)
+{
+    switch(coder)
+    {
+        case VITTER:
+            return compress_stream(log, dict_size, preset, flags, huge_pages, test, BitIn{input}, BitVitterOut{VitterOut{BitOut{output}}});
+
+        case CANONICAL:
+            return compress_stream(log, dict_size, preset, flags, huge_pages, test, BitIn{input}, BitCanonicalOut{CanonicalOut{BitOut{output}, CanonicalOut::BLOCK_SIZE}});
+
+        default:
+            return compress_stream(log, dict_size, preset, flags, huge_pages, test, BitIn{input}, BitHuffOut{HuffOut{BitOut{output}, primer(preset)}});
+    }
+}
+
+// Entropy coder end of a pipeline, codes batches until the ring is closed
+template<typename CODER>
+void code_batches(BatchRing &ring, CODER coder)
+{
+    StageTimer timer;
+    while(BatchRing::Batch *batch = ring.front())
+    {
+        coder.write(batch->data.data(), batch->size);
+        ring.pop();
+    }
+
+    gather(coder);
+    gather_stage(timer, "code");
+}
+
+// Reader, LZ parser and entropy coder of a single stream on their own
+// threads, passing batches through rings. The coder gets exactly the bytes
+// BitWriter would give it directly, so the stream does not change.
+bool compress_pipelined(Log &log, size_t dict_size, const Preset *preset, uint8_t flags, bool huge_pages, bool test, Coder coder, std::istream &input, std::ostream &output)
+{
+    BatchRing read;
+    BatchRing parsed;
+    std::thread reader{[&](void) {
+        StageTimer timer;
+        std::vector<char> buffer(1U << 16);
+        while(input.good())
+        {
+            input.read(buffer.data(), buffer.size());
+            if(!read.push(buffer.data(), input.gcount()))
+                break;
+        }
+
+        read.close();
+        gather_stage(timer, "read");
+    }};
+
+    std::thread encoder{[&](void) {
+        switch(coder)
+        {
+            case VITTER:
+                code_batches(parsed, VitterOut{BitOut{output}});
+                break;
+
+            case CANONICAL:
+                code_batches(parsed, CanonicalOut{BitOut{output}, CanonicalOut::BLOCK_SIZE});
+                break;
+
+            default:
+                code_batches(parsed, HuffOut{BitOut{output}, primer(preset)});
+                break;
+        }
+    }};
+
+    auto finish = [&](void) {
+        read.cancel();
+        parsed.close();
+        reader.join();
+        encoder.join();
+    };
+
+    bool good = false;
+    try
+    {
+        StageTimer timer;
+        good = compress_stream(log, dict_size, preset, flags, huge_pages, test, RingSource{read}, BitWriter<RingSink>{RingSink{parsed}});
+        gather_stage(timer, "parse");
+    }
+
+    catch(...)
+    {
+        finish();
+        throw;
+    }
+
+    finish();
+    return good && output.good();
+}
+
+// Entropy decoder end of a decompression pipeline. It stops at the first
+// short read, like BitReader it must not ask for more after the last symbol.
+template<typename DECODER>
+void decode_batches(BatchRing &ring, DECODER decoder)
+{
+    StageTimer timer;
+    std::vector<char> buffer(1U << 16);
+    do
+    {
+        decoder.read(buffer.data(), buffer.size());
+        if(!ring.push(buffer.data(), decoder.gcount()))
+            break;
+    }
+    while(decoder.gcount() == buffer.size());
+
+    gather(decoder);
+    gather_stage(timer, "decode");
+}
+
+// Entropy decoder, LZ reconstruction and output writes of a single stream
+// on their own threads, mirror image of compress_pipelined
+bool decompress_pipelined(Log &log, size_t dict_size, const Preset *preset, const Header &header, std::istream &input, std::ostream &output)
+{
+    BatchRing decoded;
+    BatchRing reconstructed;
+    std::thread decoder{[&](void) {
+        switch(header.coder)
+        {
+            case VITTER:
+                decode_batches(decoded, VitterIn{BitIn{input}});
+                break;
+
+            case CANONICAL:
+                decode_batches(decoded, CanonicalIn{BitIn{input}, header.block_size ? header.block_size : CanonicalIn::BLOCK_SIZE});
+                break;
+
+            default:
+                decode_batches(decoded, HuffIn{BitIn{input}, primer(preset)});
+                break;
+        }
+
+        decoded.close();
+    }};
+
+    std::thread writer{[&](void) {
+        StageTimer timer;
+        while(BatchRing::Batch *batch = reconstructed.front())
+        {
+            output.write(batch->data.data(), batch->size);
+            reconstructed.pop();
+        }
+
+        gather_stage(timer, "write");
+    }};
+
+    auto finish = [&](void) {
+        decoded.cancel();
+        reconstructed.close();
+        decoder.join();
+        writer.join();
+    };
+
+    bool good = false;
+    try
+    {
+        StageTimer timer;
+        good = decompress_stream(log, dict_size, preset, header.flags, BitWriter<RingSink>{RingSink{reconstructed}}, BitReader<RingSource>{RingSource{decoded}});
+        gather_stage(timer, "reconstruct");
+    }
+
+    catch(...)
+    {
+        finish();
+        throw;
+    }
+
+    finish();
+    return good;
+}
+
+bool decompress_with(Log &log, size_t dict_size, const Preset *preset, const Header &header, std::istream &input, std::ostream &output)
+{
+    switch(header.coder)
+    {
+        case VITTER:
+            return decompress_stream(log, dict_size, preset, header.flags, BitOut{output}, BitVitterIn{VitterIn{BitIn{input}}});
+
+        case CANONICAL:
+            return decompress_stream(log, dict_size, preset, header.flags, BitOut{output}, BitCanonicalIn{CanonicalIn{BitIn{input}, header.block_size ? header.block_size : CanonicalIn::BLOCK_SIZE}});
+
+        default:
+            return decompress_stream(log, dict_size, preset, header.flags, BitOut{output}, BitHuffIn{HuffIn{BitIn{input}, primer(preset)}});
+    }
+}
+
+// Blocks are compressed by worker threads, each with its own silent log
+FrameData compress_block(size_t dict_size, const Preset *preset, uint8_t flags, bool huge_pages, Coder coder, const std::string &block)
+{
+    StageTimer timer;
+    FrameData frame = pack_block(block, coder, [&](const std::string &data) {
+        Log log;
+        log.disable();
+
+        std::istringstream input{data};
+        std::ostringstream output;
+        if(!compress_stream(log, dict_size, preset, flags, huge_pages, false, BitIn{input}, BitOut{output}))
+            throw std::runtime_error("Block compression failed");
+
+        return output.str();
+    }, primer(preset));
+
+    gather_stage(timer, "blocks");
+    return frame;
+}
+
+std::string decompress_block(size_t dict_size, const Preset *preset, const Header &header, Frame::Type type, const std::string &block)
+{
+    StageTimer timer;
+    Log log;
+    log.disable();
+
+    std::istringstream input{block};
+    std::ostringstream output;
+    bool good = type == Frame::UNCODED
+        ? decompress_stream(log, dict_size, preset, header.flags, BitOut{output}, BitIn{input})
+        : decompress_with(log, dict_size, preset, header, input, output);
+
+    if(!good)
+        throw std::runtime_error("Corrupted frame");
+
+    gather_stage(timer, "blocks");
+    return output.str();
+}
+
 int main(int argc, char **argv)
 {
     std::string file    = "";
+    std::string preset_file = "";
+    std::string output_name = "";
+    bool adaptive       = false;
     bool compress       = true;
     bool file_output    = true;
+    bool huge_pages     = false;
     bool overwrite      = false;
+    bool pipeline       = false;
     bool quiet          = false;
+    bool recycle        = false;
+    bool stats          = false;
+    bool stats_json     = false;
     bool test           = false;
     bool verbose        = false;
     uint32_t bit_size   = 20;
+    uint32_t block_size = 4;
+    int threads         = -1;
+    Coder coder         = FGK;
 
     std::ifstream input_file;
     std::ofstream output_file;
+    MappedFile input_map;
+    MappedFile output_map;
+    std::istream mapped_input{&input_map};
+    std::ostream mapped_output{&output_map};
+
+    FdSource standard_input{STDIN_FILENO};
+    FdSink standard_output{STDOUT_FILENO};
+    std::istream fd_input{&standard_input};
+    std::ostream fd_output{&standard_output};
 
-    std::istream *input     = &std::cin;
-    std::ostream *output    = &std::cout;
+    std::istream *input     = &fd_input;
+    std::ostream *output    = &fd_output;
 
     Log log{std::cerr};
 
@@ -69,6 +401,10 @@ int main(int argc, char **argv)
         case 'V': std::cout << "lzw " << VERSION << "\n";
             return 0;
 
+        case 'A':
+            adaptive = true;
+            break;
+
         case 'c':
             file_output = false;
             break;
@@ -81,14 +417,49 @@ int main(int argc, char **argv)
             compress = false;
             break;
 
+        case 'D':
+            preset_file = optarg;
+            break;
+
+        case 'e':
+            if(!parse_coder(optarg, coder))
+            {
+                std::cerr << HELP;
+                return 1;
+            }
+
+            break;
+
         case 'f':
             overwrite = true;
             break;
 
+        case 'H':
+            huge_pages = true;
+            break;
+
+        case 'P':
+            pipeline = true;
+            break;
+
         case 'q':
             quiet = true;
             break;
 
+        case 'R':
+            recycle = true;
+            break;
+
+        case 'S':
+            if(!parse_stats(optarg, stats_json))
+            {
+                std::cerr << HELP;
+                return 1;
+            }
+
+            stats = true;
+            break;
+
         case 'v':
             verbose = true;
             break;
@@ -97,6 +468,14 @@ int main(int argc, char **argv)
             bit_size = atoi(optarg);
             break;
 
+        case 'B':
+            block_size = atoi(optarg);
+            break;
+
+        case 'p':
+            threads = atoi(optarg);
+            break;
+
         case '?':
         default: std::cerr << HELP;
             return 1;
@@ -112,11 +491,19 @@ int main(int argc, char **argv)
         log.verbose();
 
     log(Log::DEBUG) << "running with options:"
+                    << " adaptive="     << adaptive
                     << " stdout="       << !file_output
                     << " bitsize="      << bit_size
+                    << " blocksize="    << block_size
                     << " decompress="   << !compress
+                    << " dictionary="   << preset_file
+                    << " entropy="      << CODER_NAME[coder]
                     << " force="        << overwrite
+                    << " hugepages="    << huge_pages
+                    << " threads="      << threads
+                    << " pipeline="     << pipeline
                     << " quiet="        << quiet
+                    << " recycle="      << recycle
                     << " test="         << test
                     << " verbose="      << verbose
                     << " file="         << (!file.empty() ? file : "STDIN");
@@ -124,13 +511,38 @@ int main(int argc, char **argv)
     if(bit_size < 15 || bit_size > 31)
         throw std::runtime_error("Invalid bit_size for dictionary");
 
+    if(block_size > Frame::MAX_SIZE >> 20)
+        throw std::runtime_error("Invalid block_size");
+
+    // Framed streams are always decompressed in parallel
+    if(threads < 0 && compress)
+        threads = 1;
+
+    if(threads <= 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
+    Preset preset;
+    if(!preset_file.empty())
+    {
+        std::ifstream preset_input{preset_file, std::ifstream::in | std::ifstream::binary};
+        if(!preset_input || !preset.read(preset_input))
+            throw std::runtime_error("Invalid preset dictionary");
+    }
+
     if(!file.empty())
     {
         if(!file_exists(file))
             throw std::runtime_error("Input file doesn't exist");
 
-        input_file.open(file, std::ifstream::in | std::ifstream::binary);
-        input = &input_file;
+        // Regular files are read straight from their mapping
+        if(input_map.open(file))
+            input = &mapped_input;
+
+        else
+        {
+            input_file.open(file, std::ifstream::in | std::ifstream::binary);
+            input = &input_file;
+        }
     }
 
     if(file_output && !file.empty() && !test)
@@ -149,36 +561,173 @@ int main(int argc, char **argv)
         if(!overwrite && file_exists(file))
             throw std::runtime_error("Output file already exists");
 
-        output_file.open(file, std::ofstream::out | std::ofstream::binary);
-        output = &output_file;
+        output_name = file;
     }
 
+    StageTimer timer{true};
+    int status = 0;
     size_t dict_size = 1U << bit_size;
     if(compress)
     {
-        //LZW<Log &, PrepopulatedDictionary<256>, BitOut> lzw{log, PrepopulatedDictionary<256>{dict_size}, BitOut{*output}};
-        LZW<Log &, PrepopulatedDictionary<256>, BitHuffOut> lzw{log, PrepopulatedDictionary<256>{dict_size}, BitHuffOut{HuffOut{BitOut{*output}}}};
-        if(test)
-            lzw.simulate();
-
-        BitIn bitstream{*input};
-        log(log.INFO) << "Starting compression...";
-        lzw.compress(bitstream);
-        return !lzw.good();
+        Header header{ALGORITHM_LZW, (uint8_t) bit_size, coder, coder == CANONICAL ? CanonicalOut::BLOCK_SIZE : 0};
+        if(recycle)
+            header.flags |= Header::FLAG_RECYCLE;
+
+        else if(adaptive)
+            header.flags |= Header::FLAG_ADAPTIVE_RESET;
+
+        if(block_size)
+            header.flags |= Header::FLAG_FRAMED;
+
+        if(!preset_file.empty())
+        {
+            header.flags |= Header::FLAG_PRESET;
+            header.preset = preset.id;
+        }
+
+        const Preset *used = header.flags & Header::FLAG_PRESET ? &preset : nullptr;
+        if(!output_name.empty())
+        {
+            output_file.open(output_name, std::ofstream::out | std::ofstream::binary);
+            output = &output_file;
+        }
+
+        // Only counted for --stats
+        ChecksumBuffer counted{output->rdbuf()};
+        std::ostream counted_output{&counted};
+        if(stats)
+            output = &counted_output;
+
+        if(!test)
+            header.write(*output);
+
+        if(pipeline && (header.flags & Header::FLAG_FRAMED))
+            log(Log::WARNING) << "Blocks are compressed in parallel already, -P only applies to single streams (-B 0)";
+
+        // Trailer describes the data actually read from the input
+        ChecksumBuffer checked{input->rdbuf()};
+        std::istream checked_input{&checked};
+        bool good = false;
+        if(header.flags & Header::FLAG_FRAMED)
+            good = compress_framed(log, checked_input, *output, test, (size_t) block_size << 20, threads, [&](const std::string &block) {
+                return compress_block(dict_size, used, header.flags, huge_pages, coder, block);
+            });
+
+        else if(pipeline)
+            good = compress_pipelined(log, dict_size, used, header.flags, huge_pages, test, coder, checked_input, *output);
+
+        else
+            good = compress_with(log, dict_size, used, header.flags, huge_pages, test, coder, checked_input, *output);
+
+        if(!test)
+            Trailer{checked.size(), checked.value()}.write(*output);
+
+        output->flush();
+        run_stats().bytes_in = checked.size();
+        run_stats().bytes_out = counted.size();
+        status = !good;
     }
 
     else
     {
-        LZW<Log &, PrepopulatedDictionary<256>, BitOut> lzw{log, PrepopulatedDictionary<256>{dict_size - sizeof(Element)}, BitOut{*output}};
-        if(test)
-            lzw.simulate();
-
-        //BitIn bitstream{*input};
-        BitHuffIn bitstream{HuffIn{BitIn{*input}}};
-        log(log.INFO) << "Starting decompression...";
-        lzw.decompress(bitstream);
-        return !lzw.good();
+        // Only counted for --stats
+        ChecksumBuffer counted{input->rdbuf()};
+        std::istream counted_input{&counted};
+        if(stats)
+            input = &counted_input;
+
+        Header header;
+        if(!header.read(*input))
+            throw std::runtime_error("Invalid stream header");
+
+        log(Log::DEBUG) << "stream header: version=" << (int) header.version
+                        << " algorithm="    << ALGORITHM_NAME[header.algorithm]
+                        << " bitsize="      << (int) header.bit_size
+                        << " entropy="      << CODER_NAME[header.coder]
+                        << " block_size="   << header.block_size
+                        << " flags="        << (int) header.flags
+                        << " preset="       << header.preset;
+
+        if(header.has_trailer())
+        {
+            if(header.algorithm != ALGORITHM_LZW)
+                throw std::runtime_error("Stream not compressed with lzw");
+
+            if(header.bit_size < 15 || header.bit_size > 31)
+                throw std::runtime_error("Invalid bit_size for dictionary");
+
+            dict_size = 1U << header.bit_size;
+        }
+
+        if(header.flags & Header::FLAG_PRESET)
+        {
+            if(preset_file.empty())
+                throw std::runtime_error("Stream needs a preset dictionary (-D)");
+
+            if(preset.id != header.preset)
+                throw std::runtime_error("Stream was compressed with another preset dictionary");
+        }
+
+        const Preset *used = header.flags & Header::FLAG_PRESET ? &preset : nullptr;
+        if(pipeline && (header.flags & Header::FLAG_FRAMED))
+            log(Log::WARNING) << "Frames are decompressed in parallel already, -P only applies to single streams";
+
+        // Trailer at the end of a mapped input gives the expected size of the
+        // output, so it can be mapped too. It is only a hint for how much to
+        // reserve up front, the mapping grows if the output turns out longer.
+        if(!output_name.empty())
+        {
+            Trailer trailer;
+            if(header.has_trailer() && input_map.size() >= Trailer::SIZE)
+                trailer.read(input_map.begin() + input_map.size() - Trailer::SIZE);
+
+            size_t reserved = std::min<uint64_t>(trailer.length, input_map.size() * MappedFile::MAX_EXPANSION);
+            if(reserved && output_map.create(output_name, reserved))
+                output = &mapped_output;
+
+            else
+            {
+                output_file.open(output_name, std::ofstream::out | std::ofstream::binary);
+                output = &output_file;
+            }
+        }
+
+        // Output is only checksummed when testing integrity
+        TrailerBuffer trailed{input->rdbuf()};
+        ChecksumBuffer checked{test ? nullptr : output->rdbuf()};
+        std::istream body{header.has_trailer() ? &trailed : input->rdbuf()};
+        std::ostream checked_output{&checked};
+        bool good = false;
+        if(header.flags & Header::FLAG_FRAMED)
+            good = decompress_framed(log, body, checked_output, threads, [&](Frame::Type type, const std::string &block) {
+                return decompress_block(dict_size, used, header, type, block);
+            });
+
+        else if(pipeline)
+            good = decompress_pipelined(log, dict_size, used, header, body, checked_output);
+
+        else
+            good = decompress_with(log, dict_size, used, header, body, checked_output);
+
+        checked_output.flush();
+        run_stats().bytes_in = counted.size();
+        run_stats().bytes_out = checked.size();
+        if(!good)
+            status = 1;
+
+        else if(header.has_trailer())
+            status = !verify_trailer(log, trailed, checked);
+    }
+
+    if(stats)
+    {
+        timer.stop(run_stats(), "total");
+        if(stats_json)
+            run_stats().write_json(std::cerr);
+
+        else
+            run_stats().write(std::cerr);
     }
 
-    return 0;
+    return status;
 }
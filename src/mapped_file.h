@@ -0,0 +1,202 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <string>
+#include <streambuf>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef unsigned char uchar_t;
+
+// File mapped into memory as a stream buffer. Reads and writes copy
+// straight from and to the mapped pages, without read/write calls or
+// another buffer in between. Input is mapped read only, output is created
+// with its expected size reserved, grown if more is written and cut down to
+// what was actually written when closed. Both go front to back, so the
+// kernel is told to read ahead.
+class MappedFile: public std::streambuf
+{
+public:
+    // Expected output sizes come from the file being decompressed and are
+    // not trusted further than this many times its size, a corrupt trailer
+    // would reserve whatever it says. Longer output grows the mapping.
+    static const size_t MAX_EXPANSION = 32;
+
+private:
+    int     descriptor;
+    char    *data;
+    size_t  length;
+    bool    writable;
+
+public:
+    MappedFile(void);
+    ~MappedFile(void);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &name);
+    bool create(const std::string &name, size_t size);
+    void close(void);
+    bool is_open(void) const;
+
+    const uchar_t *begin(void) const;
+    size_t size(void) const;
+
+protected:
+    int overflow(int c) override;
+
+private:
+    bool map(int protection);
+}; // class MappedFile
+
+inline
+MappedFile::MappedFile(void)
+:descriptor{-1}
+,data{nullptr}
+,length{0}
+,writable{false}
+{
+}
+
+inline
+MappedFile::~MappedFile(void)
+{
+    close();
+}
+
+// False if name cannot be mapped (not a regular file), the caller falls back
+// to a stream then
+inline
+bool MappedFile::open(const std::string &name)
+{
+    close();
+    descriptor = ::open(name.c_str(), O_RDONLY);
+    struct stat status;
+    if(descriptor < 0 || fstat(descriptor, &status) || !S_ISREG(status.st_mode))
+    {
+        close();
+        return false;
+    }
+
+    length = status.st_size;
+    if(!map(PROT_READ))
+        return false;
+
+    setg(data, data, data + length);
+    return true;
+}
+
+// Blocks are reserved up front, a full disk fails here instead of raising
+// SIGBUS on a write to the mapping
+inline
+bool MappedFile::create(const std::string &name, size_t size)
+{
+    close();
+    descriptor = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(descriptor < 0 || !size || posix_fallocate(descriptor, 0, size))
+    {
+        close();
+        return false;
+    }
+
+    length = size;
+    writable = true;
+    if(!map(PROT_READ | PROT_WRITE))
+        return false;
+
+    setp(data, data + length);
+    return true;
+}
+
+// Doubles the file and its mapping, reserving the new blocks the same way
+// create does
+inline
+int MappedFile::overflow(int c)
+{
+    if(c == traits_type::eof())
+        return traits_type::not_eof(c);
+
+    size_t written = pptr() - pbase();
+    if(!writable || posix_fallocate(descriptor, length, length))
+        return traits_type::eof();
+
+    void *address = mremap(data, length, length * 2, MREMAP_MAYMOVE);
+    if(address == MAP_FAILED)
+        return traits_type::eof();
+
+    data = (char *) address;
+    length *= 2;
+    setp(data, data + length);
+    for(size_t left = written; left; left -= std::min<size_t>(left, INT_MAX))
+        pbump(std::min<size_t>(left, INT_MAX));
+
+    *pptr() = c;
+    pbump(1);
+    return c;
+}
+
+// Output keeps only the bytes written
+inline
+void MappedFile::close(void)
+{
+    size_t written = pptr() - pbase();
+    if(data)
+        munmap(data, length);
+
+    if(writable && ftruncate(descriptor, written))
+        written = 0;
+
+    if(descriptor >= 0)
+        ::close(descriptor);
+
+    descriptor = -1;
+    data = nullptr;
+    length = 0;
+    writable = false;
+    setg(nullptr, nullptr, nullptr);
+    setp(nullptr, nullptr);
+}
+
+inline
+bool MappedFile::is_open(void) const
+{
+    return descriptor >= 0;
+}
+
+inline
+const uchar_t *MappedFile::begin(void) const
+{
+    return (const uchar_t *) data;
+}
+
+inline
+size_t MappedFile::size(void) const
+{
+    return length;
+}
+
+// Empty files have nothing to map
+inline
+bool MappedFile::map(int protection)
+{
+    if(!length)
+        return true;
+
+    void *address = mmap(nullptr, length, protection, MAP_SHARED, descriptor, 0);
+    if(address == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    data = (char *) address;
+    madvise(data, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+#endif // __MAPPED_FILE_H__
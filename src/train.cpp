@@ -0,0 +1,219 @@
+/* 2015
+ * Maciej Szeptuch
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <lzw/lzw.h>
+#include <bitstream.h>
+#include <dictionary.h>
+#include <leaf_recycler.h>
+#include <preset.h>
+#include "log.h"
+#include "common.h"
+
+const char *VERSION = "0.1.0";
+const char *HELP    = "Usage: train [OPTION]... FILE...\n\
+Build a preset dictionary for lzw -D from sample FILEs, one message each.\n\n\
+-b, --bitsize     dictionary bits of streams using the preset (15-31, default=16)\n\
+-f, --force       force overwrite of output file\n\
+-h, --help        give this help\n\
+-n, --elements    phrases in the preset (default=3/4 of the dictionary)\n\
+-o, --output      preset file (default=preset.lzkp)\n\
+-q, --quiet       suppress all warnings\n\
+-V, --version     display version number\n";
+const char *SHORT_OPTIONS = "b:fhn:o:qV";
+const struct option LONG_OPTIONS[] =
+{
+    {"bitsize",     required_argument,  nullptr, 'b'},
+    {"force",       no_argument,        nullptr, 'f'},
+    {"help",        no_argument,        nullptr, 'h'},
+    {"elements",    required_argument,  nullptr, 'n'},
+    {"output",      required_argument,  nullptr, 'o'},
+    {"quiet",       no_argument,        nullptr, 'q'},
+    {"version",     no_argument,        nullptr, 'V'},
+    {nullptr, 0, nullptr, 0},
+};
+
+// Phrases of all samples from a single LZW pass. Once the dictionary is
+// full the least recently used leaves make room for new phrases, so it ends
+// up with phrases the samples keep using, not just the ones seen first.
+Preset learn_phrases(const std::vector<std::string> &samples, size_t elements)
+{
+    PrepopulatedDictionary<256> dictionary{(256 + elements) * sizeof(Element)};
+    LeafRecycler recycler{dictionary.size()};
+    for(const std::string &sample: samples)
+    {
+        size_t id = 0;
+        dictionary.select(0);
+        for(uchar_t byte: sample)
+        {
+            if(dictionary.step(byte, id))
+                continue;
+
+            recycler.touch(id);
+            if(!dictionary.full())
+            {
+                dictionary.add_suffix(byte);
+                recycler.add(dictionary.size(), id);
+            }
+
+            else if(size_t victim = recycler.victim(id))
+            {
+                recycler.remove(victim, dictionary.get_prev(victim));
+                dictionary.recycle(victim, byte);
+                recycler.add(victim, id);
+            }
+
+            dictionary.select(0);
+            dictionary.step(byte, id);
+        }
+    }
+
+    // Recycled ids can come before their prefixes, shorter phrases go first
+    std::vector<std::pair<size_t, size_t>> order;
+    for(size_t id = 257; id <= dictionary.size(); ++ id)
+    {
+        size_t length = 0;
+        for(size_t current = id; current; current = dictionary.get_prev(current))
+            ++ length;
+
+        order.emplace_back(length, id);
+    }
+
+    std::sort(begin(order), end(order));
+    std::vector<size_t> renumbered(dictionary.size() + 1);
+    for(size_t id = 1; id <= 256; ++ id)
+        renumbered[id] = id;
+
+    Preset preset;
+    for(auto &element: order)
+    {
+        renumbered[element.second] = 257 + preset.size();
+        preset.add(renumbered[dictionary.get_prev(element.second)], dictionary.get_byte(element.second));
+    }
+
+    return preset;
+}
+
+// FGK primer: bytes of the LZ codes of every sample compressed on its own,
+// starting from the preset
+void learn_counts(Preset &preset, const std::vector<std::string> &samples, size_t dict_size)
+{
+    Log log;
+    log.disable();
+
+    std::vector<uint64_t> histogram(256);
+    for(const std::string &sample: samples)
+    {
+        std::istringstream input{sample};
+        std::ostringstream output;
+        {
+            LZW<Log &, PresetDictionary<>, BitOut> lzw{log, PresetDictionary<>{&preset, dict_size}, BitOut{output}};
+            BitIn bitstream{input};
+            lzw.compress(bitstream);
+        }
+
+        for(uchar_t byte: output.str())
+            ++ histogram[byte];
+    }
+
+    preset.prime(histogram);
+}
+
+int main(int argc, char **argv)
+{
+    std::string file    = "preset.lzkp";
+    bool overwrite      = false;
+    bool quiet          = false;
+    uint32_t bit_size   = 16;
+    size_t elements     = 0;
+
+    Log log{std::cerr};
+    std::ios::sync_with_stdio(false);
+
+    int o;
+    while((o = getopt_long(argc, argv, SHORT_OPTIONS, LONG_OPTIONS, 0)) != -1) switch(o)
+    {
+        case 'h': std::cout << HELP;
+            return 0;
+
+        case 'V': std::cout << "train " << VERSION << "\n";
+            return 0;
+
+        case 'b':
+            bit_size = atoi(optarg);
+            break;
+
+        case 'f':
+            overwrite = true;
+            break;
+
+        case 'n':
+            elements = atoi(optarg);
+            break;
+
+        case 'o':
+            file = optarg;
+            break;
+
+        case 'q':
+            quiet = true;
+            break;
+
+        case '?':
+        default: std::cerr << HELP;
+            return 1;
+    }
+
+    if(optind >= argc)
+    {
+        std::cerr << HELP;
+        return 1;
+    }
+
+    if(quiet)
+        log.disable();
+
+    if(bit_size < 15 || bit_size > 31)
+        throw std::runtime_error("Invalid bit_size for dictionary");
+
+    // Decoder dictionary is one element smaller and has to take a new
+    // phrase too
+    size_t dict_size = 1U << bit_size;
+    size_t capacity = dict_size / sizeof(Element) - 256 - 2;
+    if(!elements)
+        elements = capacity / 4 * 3;
+
+    if(elements > capacity)
+        throw std::runtime_error("Too many elements for dictionary size");
+
+    if(!overwrite && file_exists(file))
+        throw std::runtime_error("Output file already exists");
+
+    std::vector<std::string> samples;
+    for(int f = optind; f < argc; ++ f)
+    {
+        std::ifstream input{argv[f], std::ifstream::in | std::ifstream::binary};
+        if(!input)
+            throw std::runtime_error(std::string("Cannot read ") + argv[f]);
+
+        samples.emplace_back(std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{});
+    }
+
+    Preset preset = learn_phrases(samples, elements);
+    learn_counts(preset, samples, dict_size);
+
+    std::ofstream output{file, std::ofstream::out | std::ofstream::binary};
+    preset.write(output);
+    if(!output)
+        throw std::runtime_error("Cannot write preset dictionary");
+
+    log(Log::INFO) << "Preset " << preset.id << ": " << preset.size() << " phrases from " << samples.size() << " samples";
+    return 0;
+}